@@ -0,0 +1,528 @@
+/*
+ *      Copyright (c) 2018~now Palo Kisa <palo.kisa@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this addon; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+/*!
+ * \file Replay benchmark of the core: the recorded API responses (fixtures)
+ * are scaled to the requested count of channels/days and fed through the
+ * CatalogManager jobs LoadPlayList(), LoadEPG(), ReleaseUnneededEPG() and
+ * LoadRecordings() (the same code run by the addon, incl. the fingerprints
+ * and the snapshot copies). The Kodi notifications are replaced by a counting
+ * sink.
+ *
+ * The zap phases run the core part of the channel switch (the addon's
+ * GetChannelStreamProperties() without the PIN check and the conversion into
+ * the Kodi properties): the snapshot, the channel lookup, the recent channel
+ * and the stream properties, precomputed (shared from the snapshot) against
+ * built on demand, for plain and DRM (registered) channels.
+ *
+ * With --capture the calls captured by the addon (the "apiCapture" setting)
+ * are replayed instead, in the captured order.
+ *
+ * Usage: sledovanitv_bench [fixtures directory]
+ *        sledovanitv_bench --capture <capture file> [fixtures directory]
+ */
+
+#include "ApiManager.h"
+#include "Catalog.h"
+#include "CatalogManager.h"
+#include "Platform.h"
+#include "Capture.h"
+#include "Fixtures.h"
+#include <json/json.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+#if !defined(BENCH_FIXTURES_DIR)
+# define BENCH_FIXTURES_DIR "fixtures"
+#endif
+
+// allocation counting
+static std::atomic<unsigned long long> g_allocations{0};
+static std::atomic<unsigned long long> g_allocatedBytes{0};
+
+void * operator new(std::size_t size)
+{
+  ++g_allocations;
+  g_allocatedBytes += size;
+  if (void * p = std::malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc{};
+}
+
+void * operator new[](std::size_t size)
+{
+  return operator new(size);
+}
+
+// Note: kept out of line, so the compiler doesn't pair the free() with the (replaced) operator new
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+static void Deallocate(void * p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void * p) noexcept
+{
+  Deallocate(p);
+}
+
+void operator delete[](void * p) noexcept
+{
+  Deallocate(p);
+}
+
+void operator delete(void * p, std::size_t /*size*/) noexcept
+{
+  Deallocate(p);
+}
+
+void operator delete[](void * p, std::size_t /*size*/) noexcept
+{
+  Deallocate(p);
+}
+
+namespace
+{
+
+using namespace sledovanitvcz;
+
+//! Serves the fixture bodies by the API function name
+class ReplayTransport : public Transport
+{
+public:
+  void Set(const std::string & function, std::string body)
+  {
+    m_bodies[function] = std::move(body);
+  }
+
+  bool Get(const std::string & url, const std::string & /*userAgent*/, std::string & response, TransferInfo & /*info*/) override
+  {
+    const size_t query = url.find('?');
+    const size_t slash = url.rfind('/', query);
+    const std::string function = url.substr(slash + 1, query == std::string::npos ? std::string::npos : query - slash - 1);
+    const auto body_i = m_bodies.find(function);
+    if (m_bodies.cend() == body_i)
+      return false;
+    response = body_i->second;
+    return true;
+  }
+
+private:
+  std::map<std::string, std::string> m_bodies;
+};
+
+class MemoryFileSystem : public FileSystem
+{
+public:
+  bool ReadFile(const std::string & path, std::string & content) override
+  {
+    const auto file_i = m_files.find(path);
+    if (m_files.cend() == file_i)
+      return false;
+    content = file_i->second;
+    return true;
+  }
+  bool WriteFile(const std::string & path, const std::string & content) override
+  {
+    m_files[path] = content;
+    return true;
+  }
+  bool AppendFile(const std::string & path, const std::string & content) override
+  {
+    m_files[path] += content;
+    return true;
+  }
+  time_t ModificationTime(const std::string & path) override
+  {
+    return 0 < m_files.count(path) ? time(nullptr) : 0;
+  }
+  std::string UserPath(const std::string & name) override
+  {
+    return "mem://" + name;
+  }
+
+private:
+  std::map<std::string, std::string> m_files;
+};
+
+//! Serves the captured calls, the fixtures for the ones not captured
+//! (the pairing/login usually is not, the addon has a stored one)
+class CaptureWithFixturesTransport : public Transport
+{
+public:
+  CaptureWithFixturesTransport(std::shared_ptr<ReplayCaptureTransport> capture, std::shared_ptr<Transport> fixtures)
+    : m_capture{std::move(capture)}
+    , m_fixtures{std::move(fixtures)}
+  {
+  }
+
+  bool Get(const std::string & url, const std::string & userAgent, std::string & response, TransferInfo & info) override
+  {
+    if (0 < m_capture->Count(ReplayCaptureTransport::Function(url)))
+      return m_capture->Get(url, userAgent, response, info);
+    return m_fixtures->Get(url, userAgent, response, info);
+  }
+
+private:
+  const std::shared_ptr<ReplayCaptureTransport> m_capture;
+  const std::shared_ptr<Transport> m_fixtures;
+};
+
+//! Stand-in for the Kodi notifications
+class CountingSink : public CatalogSink
+{
+public:
+  size_t created = 0;
+  size_t updated = 0;
+  size_t deleted = 0;
+
+  void ConnectionChanged(ConnectionState_t /*state*/) override {}
+  void ChannelsChanged(size_t /*channelCount*/) override {}
+  void RecordingsChanged() override {}
+  void TimersChanged() override {}
+  void EpgChanged(const EpgEntry & /*entry*/, EpgChange_t change) override
+  {
+    switch (change)
+    {
+      case EC_CREATED: ++created; break;
+      case EC_UPDATED: ++updated; break;
+      case EC_DELETED: ++deleted; break;
+    }
+  }
+};
+
+size_t EpgEntries(const epg_container_t & epg)
+{
+  size_t entries = 0;
+  for (const auto & channel : epg)
+    entries += channel.second.epg.size();
+  return entries;
+}
+
+long PeakRssKb()
+{
+#if defined(__unix__) || defined(__APPLE__)
+  struct rusage usage;
+  if (0 == getrusage(RUSAGE_SELF, &usage))
+# if defined(__APPLE__)
+    return usage.ru_maxrss / 1024;
+# else
+    return usage.ru_maxrss;
+# endif
+#endif
+  return 0;
+}
+
+//! Measurement of one phase
+class Probe
+{
+public:
+  Probe()
+    : m_start{std::chrono::steady_clock::now()}
+    , m_allocations{g_allocations}
+    , m_bytes{g_allocatedBytes}
+  {
+  }
+
+  void Report(const char * phase, size_t channels, int days, size_t entries) const
+  {
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_start).count();
+    const unsigned long long allocations = g_allocations - m_allocations;
+    const unsigned long long bytes = g_allocatedBytes - m_bytes;
+    const size_t n = entries ? entries : 1;
+    std::printf("%-26s %6u %4d %9u %10.2f %9.3f %12.0f %11llu %9.2f %9.1f %9.1f\n"
+        , phase, static_cast<unsigned>(channels), days, static_cast<unsigned>(entries)
+        , ms, ms * 1000.0 / n, 0 < ms ? n * 1000.0 / ms : 0.0
+        , allocations, static_cast<double>(allocations) / n, bytes / (1024.0 * 1024.0), PeakRssKb() / 1024.0);
+  }
+
+private:
+  const std::chrono::steady_clock::time_point m_start;
+  const unsigned long long m_allocations;
+  const unsigned long long m_bytes;
+};
+
+void Run(const Fixtures & fixtures, size_t channelCount, int days)
+{
+  auto transport = std::make_shared<ReplayTransport>();
+  auto file_system = std::make_shared<MemoryFileSystem>();
+  transport->Set("create-pairing", WriteJson(fixtures.pairing));
+  transport->Set("device-login", WriteJson(fixtures.login));
+  transport->Set("event-timeshift", WriteJson(fixtures.timeShift));
+  auto manager = std::make_shared<ApiManager>(ApiManager::SP_DEFAULT, "bench", "bench", "00:11:22:33:44:55", "bench", std::string{}, 0, transport, file_system);
+  if (!manager->login())
+  {
+    std::cerr << "Replayed login failed" << std::endl;
+    return;
+  }
+  CatalogManager::Settings settings;
+  settings.useAdaptive = true;
+  settings.lockedDirectory = "locked";
+  settings.epgMaxFutureDays = days;
+  settings.epgMaxPastDays = 0;
+  CountingSink sink;
+  CatalogManager catalog{manager, file_system, 0, settings, sink};
+
+  // LoadPlayList
+  transport->Set("playlist", WriteJson(ScalePlaylist(fixtures.playlist, channelCount)));
+  {
+    Probe probe;
+    catalog.LoadPlayList();
+    probe.Report("LoadPlayList", channelCount, days, catalog.Snapshot().channels->size());
+  }
+  {
+    const auto channels = catalog.Snapshot().channels;
+    Probe probe;
+    catalog.LoadPlayList();
+    probe.Report(channels == catalog.Snapshot().channels ? "LoadPlayList (unchanged)" : "LoadPlayList (changed!)", channelCount, days, channels->size());
+  }
+
+  // LoadEPG, the small (1 hour) step first (as the addon does on start)
+  const time_t now = time(nullptr);
+  {
+    transport->Set("epg", WriteJson(ScaleEpg(fixtures.epgHour, fixtures.playlist, channelCount, 0)));
+    Probe probe;
+    catalog.LoadEPG(now, true);
+    probe.Report("LoadEPG (60 min)", channelCount, days, EpgEntries(*catalog.Snapshot().epg));
+  }
+
+  // LoadEPG, the full days (each one copies and republishes the EPG snapshot)
+  {
+    std::vector<std::string> day_bodies;
+    for (int day = 0; day < days; ++day)
+      day_bodies.push_back(WriteJson(ScaleEpg(fixtures.epgDay, fixtures.playlist, channelCount, day)));
+    const time_t midnight = now - now % 86400;
+
+    Probe probe;
+    for (int day = 0; day < days; ++day)
+    {
+      transport->Set("epg", std::move(day_bodies[day]));
+      catalog.LoadEPG(midnight + day * 86400, false);
+    }
+    probe.Report("LoadEPG (1439 min)", channelCount, days, EpgEntries(*catalog.Snapshot().epg));
+  }
+
+  // ReleaseUnneededEPG, keep about the first half of the days
+  {
+    const size_t entries = EpgEntries(*catalog.Snapshot().epg);
+    catalog.SetEPGMaxDays(std::max(days / 2, 1), 0);
+    Probe probe;
+    catalog.ReleaseUnneededEPG();
+    probe.Report("ReleaseUnneededEPG", channelCount, days, entries);
+  }
+
+  // LoadRecordings
+  transport->Set("get-pvr", WriteJson(ScalePvr(fixtures.pvr, fixtures.playlist, channelCount)));
+  {
+    Probe probe;
+    catalog.LoadRecordings();
+    const CatalogSnapshot snapshot = catalog.Snapshot();
+    probe.Report("LoadRecordings", channelCount, days, snapshot.recordings->size() + snapshot.timers->size());
+  }
+
+  // event-timeshift resolution
+  {
+    Probe probe;
+    StreamInfo info;
+    size_t resolved = 0;
+    for (size_t i = 0; i < channelCount; ++i)
+      resolved += catalog.TimeShiftStreamInfo(std::to_string(i), info) ? 1 : 0;
+    probe.Report("event-timeshift", channelCount, days, resolved);
+  }
+}
+
+//! Zap through all the channels \p rounds times, the precomputed properties vs. the on demand built ones
+void RunZap(const Fixtures & fixtures, size_t channelCount, bool drm, int rounds)
+{
+  auto transport = std::make_shared<ReplayTransport>();
+  auto file_system = std::make_shared<MemoryFileSystem>();
+  transport->Set("create-pairing", WriteJson(fixtures.pairing));
+  transport->Set("device-login", WriteJson(fixtures.login));
+  auto manager = std::make_shared<ApiManager>(ApiManager::SP_DEFAULT, "bench", "bench", "00:11:22:33:44:55", "bench", std::string{}, 0, transport, file_system);
+  if (!manager->login())
+  {
+    std::cerr << "Replayed login failed" << std::endl;
+    return;
+  }
+  CatalogManager::Settings settings;
+  settings.useAdaptive = true;
+  settings.lockedDirectory = "locked";
+  CountingSink sink;
+  CatalogManager catalog{manager, file_system, 0, settings, sink};
+
+  // Note: all the channels are (not) DRM ones, the unregistered DRM channels would wait for the registration
+  Json::Value playlist = ScalePlaylist(fixtures.playlist, channelCount);
+  for (auto & channel : playlist["channels"])
+    channel["drm"] = drm ? 1 : 0;
+  if (drm)
+  {
+    Json::Value registration{Json::objectValue};
+    registration["status"] = 1;
+    Json::Value & info = registration["info"];
+    info["type"] = "widevine";
+    info["licenseHandler"]["requestEncoding"] = "binary";
+    info["licenseHandler"]["responseEncoding"] = "binary";
+    info["licenseUrl"] = "http://bench/license?streamURL={streamURL|base64}";
+    info["certificateUrl"] = "http://bench/certificate";
+    transport->Set("drm-registration", WriteJson(registration));
+    transport->Set("certificate", std::string(1024, '\x5a'));
+  }
+  transport->Set("playlist", WriteJson(playlist));
+  catalog.LoadPlayList();
+  if (drm)
+    catalog.RegisterDrm();
+
+  std::vector<int> uids;
+  for (const auto & channel : *catalog.Snapshot().channels)
+    uids.push_back(channel.iUniqueId);
+  const size_t zaps = uids.size() * rounds;
+  // as Data::GetChannelStreamProperties()
+  auto zap = [&catalog] (int channelUid, bool precomputed) {
+    const CatalogSnapshot snapshot = catalog.Snapshot();
+    const auto index_i = snapshot.channelsIndex->find(channelUid);
+    if (snapshot.channelsIndex->cend() == index_i)
+      return false;
+    const Channel & channel = (*snapshot.channels)[index_i->second];
+    catalog.SetRecentChannel(channel.strId);
+    if (precomputed)
+      return nullptr != catalog.ChannelStreamProperties(snapshot, channelUid);
+    // Note: StreamProperties() is the on demand BuildStreamProperties() with the registered DRM data
+    return !catalog.StreamProperties(channel.strStreamURL, channel.strStreamType, channel.bIsDrm, true).empty();
+  };
+  for (const bool precomputed : {true, false})
+  {
+    Probe probe;
+    size_t zapped = 0;
+    for (int round = 0; round < rounds; ++round)
+      for (const int uid : uids)
+        zapped += zap(uid, precomputed) ? 1 : 0;
+    probe.Report(precomputed ? (drm ? "zap precomputed (DRM)" : "zap precomputed") : (drm ? "zap on-demand (DRM)" : "zap on-demand")
+        , channelCount, 0, zapped == zaps ? zaps : 0);
+  }
+}
+
+void RunCapture(const Fixtures & fixtures, const std::string & path)
+{
+  auto file_system = std::make_shared<MemoryFileSystem>();
+  {
+    std::ifstream file{path};
+    std::ostringstream content;
+    content << file.rdbuf();
+    if (!file)
+    {
+      std::cerr << "Cannot read capture " << path << std::endl;
+      return;
+    }
+    file_system->WriteFile(path, content.str());
+  }
+  auto capture = std::make_shared<ReplayCaptureTransport>(file_system, path);
+  auto fallback = std::make_shared<ReplayTransport>();
+  fallback->Set("create-pairing", WriteJson(fixtures.pairing));
+  fallback->Set("device-login", WriteJson(fixtures.login));
+  auto manager = std::make_shared<ApiManager>(ApiManager::SP_DEFAULT, "bench", "bench", "00:11:22:33:44:55", "bench", std::string{}, 0
+    , std::make_shared<CaptureWithFixturesTransport>(capture, fallback), file_system);
+  if (!manager->login())
+  {
+    std::cerr << "Replayed login failed" << std::endl;
+    return;
+  }
+  CatalogManager::Settings settings;
+  settings.useAdaptive = true;
+  settings.lockedDirectory = "locked";
+  CountingSink sink;
+  CatalogManager catalog{manager, file_system, 0, settings, sink};
+
+  {
+    Probe probe;
+    for (size_t i = capture->Count("playlist"); 0 < i; --i)
+      catalog.LoadPlayList();
+    probe.Report("playlist", catalog.Snapshot().channels->size(), 0, capture->Count("playlist"));
+  }
+
+  {
+    // Note: the captured windows are unknown, distinct (consecutive) ones are requested
+    // so none of the calls is skipped as already loaded
+    const time_t now = time(nullptr);
+    const time_t midnight = now - now % 86400;
+    const size_t count = capture->Count("epg");
+    Probe probe;
+    for (size_t i = 0; i < count; ++i)
+      catalog.LoadEPG(midnight + i * 86400, false);
+    probe.Report("epg", catalog.Snapshot().channels->size(), 0, EpgEntries(*catalog.Snapshot().epg));
+  }
+
+  {
+    Probe probe;
+    for (size_t i = capture->Count("get-pvr"); 0 < i; --i)
+      catalog.LoadRecordings();
+    const CatalogSnapshot snapshot = catalog.Snapshot();
+    probe.Report("get-pvr", snapshot.channels->size(), 0, snapshot.recordings->size() + snapshot.timers->size());
+  }
+}
+
+} // namespace
+
+int main(int argc, char * argv[])
+{
+  std::string capture;
+  if (2 < argc && std::string{"--capture"} == argv[1])
+  {
+    capture = argv[2];
+    argv += 2;
+    argc -= 2;
+  }
+  Fixtures fixtures;
+  if (!fixtures.Load(1 < argc ? argv[1] : BENCH_FIXTURES_DIR))
+    return 1;
+
+  std::printf("%-26s %6s %4s %9s %10s %9s %12s %11s %9s %9s %9s\n"
+      , "phase", "chans", "days", "entries", "total[ms]", "[us]/ent", "entries/s", "allocs", "alloc/ent", "alloc[MB]", "RSS[MB]");
+  if (!capture.empty())
+  {
+    RunCapture(fixtures, capture);
+    return 0;
+  }
+  for (const size_t channels : {100, 300, 1000})
+    for (const int days : {1, 7, 14})
+      Run(fixtures, channels, days);
+  for (const bool drm : {false, true})
+    for (const size_t channels : {100, 300, 1000})
+      RunZap(fixtures, channels, drm, 10);
+  return 0;
+}
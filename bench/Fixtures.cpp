@@ -0,0 +1,149 @@
+/*
+ *      Copyright (c) 2018~now Palo Kisa <palo.kisa@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this addon; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include "Fixtures.h"
+#include "Catalog.h"
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace sledovanitvcz
+{
+
+static bool ReadFixture(const std::string & dir, const std::string & name, Json::Value & root)
+{
+  std::ifstream file{dir + '/' + name + ".json"};
+  std::ostringstream content;
+  content << file.rdbuf();
+  if (!file || !ParseJson(content.str(), root))
+  {
+    std::cerr << "Cannot read fixture " << dir << '/' << name << ".json" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+std::string WriteJson(const Json::Value & root)
+{
+  Json::StreamWriterBuilder builder;
+  builder["indentation"] = "";
+  return Json::writeString(builder, root);
+}
+
+std::string ShiftDays(const std::string & dateTime, int days)
+{
+  if (0 == days)
+    return dateTime;
+  struct tm t = {};
+  if (5 != std::sscanf(dateTime.c_str(), "%d-%d-%d %d:%d", &t.tm_year, &t.tm_mon, &t.tm_mday, &t.tm_hour, &t.tm_min))
+    return dateTime;
+  t.tm_year -= 1900;
+  t.tm_mon -= 1;
+  t.tm_mday += days;
+  t.tm_isdst = -1;
+  std::mktime(&t);
+  char buf[17];
+  std::strftime(buf, sizeof (buf), "%Y-%m-%d %H:%M", &t);
+  return buf;
+}
+
+static std::string ScaledId(const std::string & id, size_t i)
+{
+  return id + '-' + std::to_string(i);
+}
+
+Json::Value ScalePlaylist(const Json::Value & fixture, size_t count)
+{
+  Json::Value root{fixture};
+  Json::Value & channels = root["channels"];
+  channels = Json::Value{Json::arrayValue};
+  const Json::Value & templates = fixture["channels"];
+  for (size_t i = 0; i < count; ++i)
+  {
+    Json::Value channel{templates[static_cast<Json::ArrayIndex>(i % templates.size())]};
+    channel["id"] = ScaledId(channel["id"].asString(), i);
+    channel["name"] = channel["name"].asString() + ' ' + std::to_string(i);
+    channels.append(std::move(channel));
+  }
+  return root;
+}
+
+Json::Value ScaleEpg(const Json::Value & fixture, const Json::Value & playlistFixture, size_t count, int day)
+{
+  Json::Value root{Json::objectValue};
+  root["status"] = 1;
+  Json::Value & channels = root["channels"];
+  const Json::Value & templates = playlistFixture["channels"];
+  for (size_t i = 0; i < count; ++i)
+  {
+    const std::string template_id = templates[static_cast<Json::ArrayIndex>(i % templates.size())]["id"].asString();
+    const std::string id = ScaledId(template_id, i);
+    Json::Value & entries = channels[id];
+    entries = Json::Value{Json::arrayValue};
+    for (const auto & fixture_entry : fixture["channels"][template_id])
+    {
+      Json::Value entry{fixture_entry};
+      entry["channel"] = id;
+      entry["eventId"] = ScaledId(entry["eventId"].asString(), i) + '-' + std::to_string(day);
+      entry["startTime"] = ShiftDays(entry["startTime"].asString(), day);
+      entry["endTime"] = ShiftDays(entry["endTime"].asString(), day);
+      entries.append(std::move(entry));
+    }
+  }
+  return root;
+}
+
+Json::Value ScalePvr(const Json::Value & fixture, const Json::Value & playlistFixture, size_t count)
+{
+  Json::Value root{fixture};
+  Json::Value & records = root["records"];
+  records = Json::Value{Json::arrayValue};
+  const Json::Value & templates = playlistFixture["channels"];
+  Json::UInt id = 100000;
+  for (size_t i = 0; i < count; ++i)
+  {
+    const std::string template_id = templates[static_cast<Json::ArrayIndex>(i % templates.size())]["id"].asString();
+    for (const auto & fixture_record : fixture["records"])
+    {
+      if (fixture_record["channel"].asString() != template_id)
+        continue;
+      Json::Value record{fixture_record};
+      record["id"] = ++id;
+      record["channel"] = ScaledId(template_id, i);
+      records.append(std::move(record));
+    }
+  }
+  return root;
+}
+
+bool Fixtures::Load(const std::string & dir)
+{
+  return ReadFixture(dir, "playlist", playlist)
+    && ReadFixture(dir, "epg-1439", epgDay)
+    && ReadFixture(dir, "epg-60", epgHour)
+    && ReadFixture(dir, "get-pvr", pvr)
+    && ReadFixture(dir, "event-timeshift", timeShift)
+    && ReadFixture(dir, "create-pairing", pairing)
+    && ReadFixture(dir, "device-login", login);
+}
+
+} // namespace sledovanitvcz
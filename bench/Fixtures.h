@@ -0,0 +1,61 @@
+/*
+ *      Copyright (c) 2018~now Palo Kisa <palo.kisa@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this addon; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#ifndef sledovanitvcz_Fixtures_h
+#define sledovanitvcz_Fixtures_h
+
+#include <json/json.h>
+#include <string>
+
+/*!
+ * \file Recorded API responses (bench/fixtures) and their scaling
+ * to the requested count of channels/days. Shared by the replay
+ * benchmark and the mock server.
+ */
+
+namespace sledovanitvcz
+{
+
+struct Fixtures
+{
+  Json::Value playlist;
+  Json::Value epgDay; //!< the "1439" minutes window
+  Json::Value epgHour; //!< the "60" minutes window
+  Json::Value pvr;
+  Json::Value timeShift;
+  Json::Value pairing;
+  Json::Value login;
+
+  bool Load(const std::string & dir);
+};
+
+//! Compact JSON serialization
+std::string WriteJson(const Json::Value & root);
+//! Shift the backend time "YYYY-MM-DD HH:MM" by \p days
+std::string ShiftDays(const std::string & dateTime, int days);
+//! Clone the fixture channels up to \p count
+Json::Value ScalePlaylist(const Json::Value & fixture, size_t count);
+//! Epg of the scaled channels, shifted by \p day
+Json::Value ScaleEpg(const Json::Value & fixture, const Json::Value & playlistFixture, size_t count, int day);
+//! Records of the scaled channels
+Json::Value ScalePvr(const Json::Value & fixture, const Json::Value & playlistFixture, size_t count);
+
+} // namespace sledovanitvcz
+#endif // sledovanitvcz_Fixtures_h
@@ -0,0 +1,594 @@
+/*
+ *      Copyright (c) 2018~now Palo Kisa <palo.kisa@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this addon; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+
+/*!
+ * \file Local mock of the sledovanitv.cz API for profiling and fault
+ * injection without touching the real service. The responses are built
+ * from the recorded fixtures scaled to the requested count of channels.
+ * Point the addon to it by the "apiUrl" instance setting,
+ * e.g. http://127.0.0.1:8080/api/
+ *
+ * Usage: sledovanitv_mock_server [options]
+ *   --port N            listening port (8080)
+ *   --channels N        count of channels (100)
+ *   --fixtures DIR      fixtures directory
+ *   --latency MS        added latency of every response (0)
+ *   --jitter MS         random latency added on top of --latency (0)
+ *   --bandwidth KBPS    cap of the response transfer rate, 0 - unlimited (0)
+ *   --error-rate P      probability of the {"status":0} response (0)
+ *   --http-error-rate P probability of the HTTP 500 response (0)
+ *   --session-ttl S     session lifetime, 0 - unlimited (0)
+ *   --seed N            seed of the random generator (1)
+ */
+
+#include "Catalog.h"
+#include "ApiManager.h"
+#include "Fixtures.h"
+#include <json/json.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#if !defined(BENCH_FIXTURES_DIR)
+# define BENCH_FIXTURES_DIR "fixtures"
+#endif
+
+namespace
+{
+
+using namespace sledovanitvcz;
+
+//! The first day of the fixtures EPG
+const char * const FIXTURES_EPG_BASE = "2024-03-04 06:00";
+const int DAY = 86400;
+
+struct Options
+{
+  int port = 8080;
+  size_t channels = 100;
+  std::string fixtures = BENCH_FIXTURES_DIR;
+  int latency = 0;
+  int jitter = 0;
+  int bandwidth = 0;
+  double errorRate = 0.0;
+  double httpErrorRate = 0.0;
+  int sessionTtl = 0;
+  unsigned seed = 1;
+};
+
+struct Request
+{
+  std::string function;
+  std::string host;
+  std::string cookie; //!< PHPSESSID from the Cookie header
+  std::map<std::string, std::string> params;
+};
+
+struct Response
+{
+  Response(int responseStatus, std::string responseBody)
+    : status{responseStatus}
+    , body{std::move(responseBody)}
+  {}
+
+  int status;
+  std::string body;
+  std::string cookie; //!< PHPSESSID to set
+};
+
+std::string UrlDecode(const std::string & str)
+{
+  std::string result;
+  for (size_t i = 0; i < str.size(); ++i)
+  {
+    if (str[i] == '%' && i + 2 < str.size())
+    {
+      result += static_cast<char>(std::strtol(str.substr(i + 1, 2).c_str(), nullptr, 16));
+      i += 2;
+    } else if (str[i] == '+')
+      result += ' ';
+    else
+      result += str[i];
+  }
+  return result;
+}
+
+bool ParseRequest(const std::string & head, Request & request)
+{
+  // GET /api/function?query HTTP/1.1
+  if (0 != head.compare(0, 4, "GET "))
+    return false;
+  const size_t path_end = head.find(' ', 4);
+  if (std::string::npos == path_end)
+    return false;
+  const std::string target = head.substr(4, path_end - 4);
+  const size_t query = target.find('?');
+  const std::string path = target.substr(0, query);
+  request.function = path.substr(path.rfind('/') + 1);
+  if (std::string::npos != query)
+  {
+    size_t pos = query + 1;
+    while (pos < target.size())
+    {
+      size_t amp = target.find('&', pos);
+      if (std::string::npos == amp)
+        amp = target.size();
+      const std::string pair = target.substr(pos, amp - pos);
+      const size_t eq = pair.find('=');
+      request.params[UrlDecode(pair.substr(0, eq))] = std::string::npos == eq ? std::string{} : UrlDecode(pair.substr(eq + 1));
+      pos = amp + 1;
+    }
+  }
+  const size_t host = head.find("\r\nHost: ");
+  if (std::string::npos != host)
+    request.host = head.substr(host + 8, head.find("\r\n", host + 8) - host - 8);
+  // the session is sent as the parameter or kept as the cookie (the calls without parameters)
+  const size_t cookie = head.find("PHPSESSID=", head.find("\r\nCookie: "));
+  if (std::string::npos != cookie)
+    request.cookie = head.substr(cookie + 10, head.find_first_of(";\r", cookie + 10) - cookie - 10);
+  return true;
+}
+
+class MockServer
+{
+public:
+  MockServer(const Options & options, const Fixtures & fixtures)
+    : m_options(options)
+    , m_fixtures(fixtures)
+    , m_random{options.seed}
+    , m_epgBase{ParseDateTime(FIXTURES_EPG_BASE)}
+    , m_playlist{WriteJson(ScalePlaylist(fixtures.playlist, options.channels))}
+    , m_pvr{ScalePvr(fixtures.pvr, fixtures.playlist, options.channels)}
+    , m_nextSession{0}
+    , m_nextRecordId{200000}
+  {
+  }
+
+  Response Handle(const Request & request)
+  {
+    std::lock_guard<std::mutex> critical(m_mutex);
+    if (Chance(m_options.httpErrorRate))
+      return Response{500, "Internal Server Error"};
+    if (Chance(m_options.errorRate))
+      return Error("mock failure");
+
+    const auto handler_i = HANDLERS.find(request.function);
+    if (HANDLERS.cend() == handler_i)
+      return Response{404, "Not Found"};
+    if (handler_i->second.second && !SessionValid(request))
+      return Error("not logged");
+    return (this->*handler_i->second.first)(request);
+  }
+
+  int Delay()
+  {
+    std::lock_guard<std::mutex> critical(m_mutex);
+    if (0 >= m_options.jitter)
+      return m_options.latency;
+    return m_options.latency + std::uniform_int_distribution<int>{0, m_options.jitter}(m_random);
+  }
+
+private:
+  typedef Response (MockServer::*handler_t)(const Request &);
+  //! function -> (handler, session needed)
+  static const std::map<std::string, std::pair<handler_t, bool>> HANDLERS;
+
+  static Response Error(const std::string & error)
+  {
+    Json::Value root{Json::objectValue};
+    root["status"] = 0;
+    root["error"] = error;
+    return Response{200, WriteJson(root)};
+  }
+
+  static Response Success(Json::Value root = Json::Value{Json::objectValue})
+  {
+    root["status"] = 1;
+    return Response{200, WriteJson(root)};
+  }
+
+  static std::string Param(const Request & request, const std::string & name)
+  {
+    const auto param_i = request.params.find(name);
+    return request.params.cend() == param_i ? std::string{} : param_i->second;
+  }
+
+  bool Chance(double probability)
+  {
+    return 0.0 < probability && std::uniform_real_distribution<double>{}(m_random) < probability;
+  }
+
+  bool SessionValid(const Request & request)
+  {
+    const std::string session = Param(request, "PHPSESSID");
+    const auto session_i = m_sessions.find(session.empty() ? request.cookie : session);
+    if (m_sessions.cend() == session_i)
+      return false;
+    if (0 != session_i->second && session_i->second <= time(nullptr))
+    {
+      m_sessions.erase(session_i);
+      return false;
+    }
+    return true;
+  }
+
+  //! The scaled EPG of the fixtures day \p day, indexed by the eventId
+  const Json::Value & EpgDay(int day)
+  {
+    auto day_i = m_epgDays.find(day);
+    if (m_epgDays.cend() != day_i)
+      return day_i->second;
+    // keep just a few days around
+    if (16 < m_epgDays.size())
+      m_epgDays.erase(m_epgDays.begin());
+    day_i = m_epgDays.emplace(day, ScaleEpg(m_fixtures.epgDay, m_fixtures.playlist, m_options.channels, day)).first;
+    for (const auto & channel : day_i->second["channels"])
+      for (const auto & entry : channel)
+        m_events[entry["eventId"].asString()] = entry;
+    return day_i->second;
+  }
+
+  Response CreatePairing(const Request & /*request*/)
+  {
+    return Success(m_fixtures.pairing);
+  }
+
+  Response DeletePairing(const Request & /*request*/)
+  {
+    return Success();
+  }
+
+  Response DeviceLogin(const Request & /*request*/)
+  {
+    Json::Value root{m_fixtures.login};
+    const std::string session = "mock-session-" + std::to_string(++m_nextSession);
+    m_sessions[session] = 0 < m_options.sessionTtl ? time(nullptr) + m_options.sessionTtl : 0;
+    root["PHPSESSID"] = session;
+    Response response = Success(root);
+    response.cookie = session;
+    return response;
+  }
+
+  Response KeepAlive(const Request & /*request*/)
+  {
+    return Success();
+  }
+
+  Response PinUnlock(const Request & request)
+  {
+    return Param(request, "pin") == "1234" ? Success() : Error("bad pin");
+  }
+
+  Response Playlist(const Request & /*request*/)
+  {
+    return Response{200, m_playlist};
+  }
+
+  Response StreamQualities(const Request & /*request*/)
+  {
+    Json::Value root{Json::objectValue};
+    root["qualities"] = Json::Value{Json::arrayValue};
+    return Success(root);
+  }
+
+  Response Epg(const Request & request)
+  {
+    const time_t start = ParseDateTime(Param(request, "time"));
+    const time_t end = start + std::atoi(Param(request, "duration").c_str()) * 60;
+    if (0 >= start || end <= start)
+      return Error("bad time");
+
+    // the events overlapping the requested window, from the (shifted) fixtures days
+    const int first_day = static_cast<int>((start - m_epgBase) / DAY) - (start < m_epgBase ? 1 : 0);
+    Json::Value root{Json::objectValue};
+    Json::Value & channels = root["channels"];
+    channels = Json::Value{Json::objectValue};
+    for (int day = first_day - 1; day <= first_day + (end - start) / DAY + 1; ++day)
+    {
+      const Json::Value & epg_day = EpgDay(day);
+      for (auto channel_i = epg_day["channels"].begin(); channel_i != epg_day["channels"].end(); ++channel_i)
+      {
+        Json::Value & entries = channels[channel_i.name()];
+        if (entries.isNull())
+          entries = Json::Value{Json::arrayValue};
+        for (const auto & entry : *channel_i)
+          if (ParseDateTime(entry["startTime"].asString()) < end && ParseDateTime(entry["endTime"].asString()) > start)
+            entries.append(entry);
+      }
+    }
+    return Success(root);
+  }
+
+  Response GetPvr(const Request & /*request*/)
+  {
+    return Success(m_pvr);
+  }
+
+  Json::Value * FindRecord(const std::string & recordId)
+  {
+    for (auto & record : m_pvr["records"])
+      if (record["id"].asString() == recordId)
+        return &record;
+    return nullptr;
+  }
+
+  Response RecordTimeShift(const Request & request)
+  {
+    const Json::Value * record = FindRecord(Param(request, "recordId"));
+    if (nullptr == record)
+      return Error("no record");
+    Json::Value root{Json::objectValue};
+    root["url"] = "https://sledovanitv.cz/vod/record/" + (*record)["id"].asString() + "/playlist.m3u8";
+    root["channel"] = (*record)["channel"];
+    root["drm"] = 0;
+    return Success(root);
+  }
+
+  Response EventTimeShift(const Request & request)
+  {
+    const auto event_i = m_events.find(Param(request, "eventId"));
+    if (m_events.cend() == event_i)
+      return Error("no event");
+    Json::Value root{m_fixtures.timeShift};
+    root["eventId"] = event_i->first;
+    root["channel"] = event_i->second["channel"];
+    root["duration"] = event_i->second["duration"];
+    root["url"] = "https://sledovanitv.cz/vod/timeshift/" + event_i->first + "/playlist.m3u8";
+    return Success(root);
+  }
+
+  Response RecordEvent(const Request & request)
+  {
+    const auto event_i = m_events.find(Param(request, "eventId"));
+    if (m_events.cend() == event_i)
+      return Error("no event");
+    const Json::Value & event = event_i->second;
+    Json::Value record{Json::objectValue};
+    record["id"] = ++m_nextRecordId;
+    record["channel"] = event["channel"];
+    record["title"] = event["title"];
+    record["startTime"] = event["startTime"];
+    record["duration"] = event["duration"];
+    record["expires"] = ApiManager::formatTime(time(nullptr) + 30 * DAY).substr(0, 10);
+    record["channelLocked"] = "none";
+    record["event"]["description"] = event["description"];
+    record["enabled"] = 1;
+    m_pvr["records"].append(record);
+    Json::Value root{Json::objectValue};
+    root["recordId"] = record["id"].asString();
+    return Success(root);
+  }
+
+  Response DeleteRecord(const Request & request)
+  {
+    const std::string record_id = Param(request, "recordId");
+    Json::Value records{Json::arrayValue};
+    for (const auto & record : m_pvr["records"])
+      if (record["id"].asString() != record_id)
+        records.append(record);
+    if (records.size() == m_pvr["records"].size())
+      return Error("no record");
+    m_pvr["records"] = std::move(records);
+    return Success();
+  }
+
+  Response DrmRegistration(const Request & request)
+  {
+    Json::Value root{Json::objectValue};
+    Json::Value & info = root["info"];
+    info["type"] = "widevine";
+    info["licenseHandler"]["requestEncoding"] = "binary";
+    info["licenseHandler"]["responseEncoding"] = "binary";
+    info["licenseUrl"] = "http://" + request.host + "/drm/license";
+    info["certificateUrl"] = "http://" + request.host + "/drm/certificate";
+    return Success(root);
+  }
+
+  Response Certificate(const Request & /*request*/)
+  {
+    return Response{200, std::string("mock-widevine-certificate\0\x01\x02", 28)};
+  }
+
+private:
+  const Options m_options;
+  const Fixtures & m_fixtures;
+  std::mutex m_mutex;
+  std::mt19937 m_random;
+  const time_t m_epgBase;
+  const std::string m_playlist;
+  Json::Value m_pvr;
+  std::map<int, Json::Value> m_epgDays;
+  std::unordered_map<std::string, Json::Value> m_events;
+  //! session -> expiration (0 - never)
+  std::unordered_map<std::string, time_t> m_sessions;
+  unsigned m_nextSession;
+  Json::UInt m_nextRecordId;
+};
+
+const std::map<std::string, std::pair<MockServer::handler_t, bool>> MockServer::HANDLERS = {
+  {"create-pairing", {&MockServer::CreatePairing, false}}
+  , {"delete-pairing", {&MockServer::DeletePairing, false}}
+  , {"device-login", {&MockServer::DeviceLogin, false}}
+  , {"keepalive", {&MockServer::KeepAlive, true}}
+  , {"pin-unlock", {&MockServer::PinUnlock, true}}
+  , {"playlist", {&MockServer::Playlist, true}}
+  , {"get-stream-qualities", {&MockServer::StreamQualities, true}}
+  , {"epg", {&MockServer::Epg, true}}
+  , {"get-pvr", {&MockServer::GetPvr, true}}
+  , {"record-timeshift", {&MockServer::RecordTimeShift, true}}
+  , {"event-timeshift", {&MockServer::EventTimeShift, true}}
+  , {"record-event", {&MockServer::RecordEvent, true}}
+  , {"delete-record", {&MockServer::DeleteRecord, true}}
+  , {"drm-registration", {&MockServer::DrmRegistration, true}}
+  , {"certificate", {&MockServer::Certificate, false}}
+};
+
+bool SendAll(int fd, const char * data, size_t size)
+{
+  while (0 < size)
+  {
+    const ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+    if (0 >= sent)
+      return false;
+    data += sent;
+    size -= sent;
+  }
+  return true;
+}
+
+void Serve(MockServer & server, int bandwidth, int fd)
+{
+  const auto start = std::chrono::steady_clock::now();
+  std::string head;
+  char buf[4096];
+  while (std::string::npos == head.find("\r\n\r\n") && head.size() < 65536)
+  {
+    const ssize_t received = recv(fd, buf, sizeof (buf), 0);
+    if (0 >= received)
+      break;
+    head.append(buf, received);
+  }
+
+  Request request;
+  const Response response = ParseRequest(head, request) ? server.Handle(request) : Response{400, "Bad Request"};
+  std::this_thread::sleep_for(std::chrono::milliseconds{server.Delay()});
+
+  std::string header = "HTTP/1.1 " + std::to_string(response.status) + (200 == response.status ? " OK" : " Error") + "\r\n";
+  header += "Content-Type: application/json; charset=utf-8\r\n";
+  header += "Content-Length: " + std::to_string(response.body.size()) + "\r\n";
+  if (!response.cookie.empty())
+    header += "Set-Cookie: PHPSESSID=" + response.cookie + "; path=/\r\n";
+  header += "Connection: close\r\n\r\n";
+  bool ok = SendAll(fd, header.data(), header.size());
+  if (0 >= bandwidth)
+  {
+    ok = ok && SendAll(fd, response.body.data(), response.body.size());
+  } else
+  {
+    // bandwidth cap, the body is sent in 100ms slices
+    const size_t slice = std::max<size_t>(1, bandwidth * 1024 / 10);
+    for (size_t pos = 0; ok && pos < response.body.size(); pos += slice)
+    {
+      if (0 < pos)
+        std::this_thread::sleep_for(std::chrono::milliseconds{100});
+      ok = SendAll(fd, response.body.data() + pos, std::min(slice, response.body.size() - pos));
+    }
+  }
+  close(fd);
+
+  const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  std::printf("%-20s %3d %9u %8.1f ms%s\n", request.function.c_str(), response.status
+      , static_cast<unsigned>(response.body.size()), ms, ok ? "" : " (send failed)");
+  std::fflush(stdout);
+}
+
+bool ParseOptions(int argc, char * argv[], Options & options)
+{
+  for (int i = 1; i < argc; ++i)
+  {
+    const std::string name = argv[i];
+    if (i + 1 >= argc)
+      return false;
+    const char * value = argv[++i];
+    if (name == "--port")
+      options.port = std::atoi(value);
+    else if (name == "--channels")
+      options.channels = std::strtoul(value, nullptr, 10);
+    else if (name == "--fixtures")
+      options.fixtures = value;
+    else if (name == "--latency")
+      options.latency = std::atoi(value);
+    else if (name == "--jitter")
+      options.jitter = std::atoi(value);
+    else if (name == "--bandwidth")
+      options.bandwidth = std::atoi(value);
+    else if (name == "--error-rate")
+      options.errorRate = std::atof(value);
+    else if (name == "--http-error-rate")
+      options.httpErrorRate = std::atof(value);
+    else if (name == "--session-ttl")
+      options.sessionTtl = std::atoi(value);
+    else if (name == "--seed")
+      options.seed = std::strtoul(value, nullptr, 10);
+    else
+      return false;
+  }
+  return 0 < options.port && 0 < options.channels;
+}
+
+} // namespace
+
+int main(int argc, char * argv[])
+{
+  Options options;
+  if (!ParseOptions(argc, argv, options))
+  {
+    std::cerr << "Usage: " << argv[0] << " [--port N] [--channels N] [--fixtures DIR] [--latency MS] [--jitter MS]"
+      " [--bandwidth KBPS] [--error-rate P] [--http-error-rate P] [--session-ttl S] [--seed N]" << std::endl;
+    return 1;
+  }
+  Fixtures fixtures;
+  if (!fixtures.Load(options.fixtures))
+    return 1;
+
+  signal(SIGPIPE, SIG_IGN);
+  const int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  const int reuse = 1;
+  setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof (reuse));
+  struct sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(static_cast<uint16_t>(options.port));
+  if (0 > listen_fd
+      || 0 != bind(listen_fd, reinterpret_cast<struct sockaddr *>(&address), sizeof (address))
+      || 0 != listen(listen_fd, 64))
+  {
+    std::perror("Cannot listen");
+    return 1;
+  }
+
+  MockServer server{options, fixtures};
+  std::printf("Mock API listening on http://127.0.0.1:%d/api/ (%u channels)\n", options.port, static_cast<unsigned>(options.channels));
+  std::fflush(stdout);
+  for (;;)
+  {
+    const int fd = accept(listen_fd, nullptr, nullptr);
+    if (0 > fd)
+      continue;
+    std::thread{Serve, std::ref(server), options.bandwidth, fd}.detach();
+  }
+  return 0;
+}
@@ -1,6 +1,7 @@
 #include "Addon.h"
 
 #include "Data.h"
+#include "KodiPlatform.h"
 #include "kodi/General.h"
 #include <memory>
 
@@ -9,6 +10,8 @@ namespace sledovanitvcz
   ADDON_STATUS Addon::Create()
   {
     kodi::Log(ADDON_LOG_DEBUG, "%s - Creating the PVR sledovanitv.cz (unofficial)", __FUNCTION__);
+    // the core logs through Kodi
+    SetLogger(std::make_shared<KodiLogger>());
     return ADDON_STATUS_OK;
   }
 
@@ -52,9 +52,9 @@
 #include <iostream>
 
 #include "ApiManager.h"
+#include "Trace.h"
 #include "picosha2.h"
-#include "kodi/General.h"
-#include "kodi/Filesystem.h"
+#include "base64.hpp"
 #include <ctime>
 #include <sstream>
 #include <iomanip>
@@ -68,6 +68,11 @@ namespace sledovanitvcz
 const std::string ApiManager::API_URL[SP_END] = { "https://sledovanitv.cz/api/", "https://api.moderntv.eu/api/" };
 const std::string ApiManager::API_UNIT[SP_END] = { "default", "modernitv" };
 const std::string ApiManager::PAIR_FILE = "pairinfo";
+const std::string ApiManager::SESSION_FILE = "session";
+const std::string ApiManager::DRM_FILE = "drm";
+const std::string ApiManager::STORED_PLAYLIST = "stored-playlist";
+const std::string ApiManager::STORED_PVR = "stored-pvr";
+static constexpr time_t DRM_CACHE_TTL = 7 * 86400; //!< validity of stored DRM registration
 
 /* Converts a hex character to its integer value */
 char from_hex(char ch)
@@ -92,13 +97,13 @@ static std::string get_mac_address()
 {
   std::string mac_addr;
 #if defined(TARGET_ANDROID) && __ANDROID_API__ < 24
-  kodi::Log(ADDON_LOG_INFO, "Can't get MAC address with target Android API < 24 (no getifaddrs() support)");
+  Log(LL_INFO, "Can't get MAC address with target Android API < 24 (no getifaddrs() support)");
 #endif
 #if defined(TARGET_LINUX) || defined(TARGET_FREEBSD) || defined(TARGET_DARWIN)
     struct ifaddrs * addrs;
     if (0 != getifaddrs(&addrs))
     {
-      kodi::Log(ADDON_LOG_INFO, "While getting MAC address getifaddrs() failed, %s", strerror(errno));
+      Log(LL_INFO, "While getting MAC address getifaddrs() failed, %s", strerror(errno));
       return mac_addr;
     }
     std::unique_ptr<struct ifaddrs, decltype (&freeifaddrs)> if_addrs{addrs, &freeifaddrs};
@@ -154,7 +159,7 @@ static std::string get_mac_address()
       }
     } else
     {
-      kodi::Log(ADDON_LOG_INFO, "GetAdaptersAddresses failed...");
+      Log(LL_INFO, "GetAdaptersAddresses failed...");
     }
 #endif
     return mac_addr;
@@ -162,8 +167,8 @@ static std::string get_mac_address()
 
 std::string ApiManager::formatTime(time_t t)
 {
-  std::string buf(17, ' ');
-  std::strftime(const_cast<char *>(buf.data()), buf.size(), "%Y-%m-%d %H:%M", std::localtime(&t));
+  std::string buf(17, ' '); // "YYYY-MM-DD HH:MM" + the terminating null
+  buf.resize(std::strftime(&buf[0], buf.size(), "%Y-%m-%d %H:%M", std::localtime(&t)));
   return buf;
 }
 
@@ -172,20 +177,27 @@ ApiManager::ApiManager(ServiceProvider_t serviceProvider
     , const std::string & userPassword
     , const std::string & overridenMac
     , const std::string & product
-    , uint64_t instanceNo)
+    , const std::string & apiUrl
+    , uint64_t instanceNo
+    , std::shared_ptr<Transport> transport
+    , std::shared_ptr<FileSystem> fileSystem)
   : m_serviceProvider{serviceProvider}
   , m_userName{userName}
   , m_userPassword{userPassword}
   , m_overridenMac{overridenMac}
   , m_product{product}
+  , m_apiUrl{apiUrl.empty() ? API_URL[serviceProvider] : (apiUrl.back() == '/' ? apiUrl : apiUrl + '/')}
   , m_instanceNo{instanceNo}
   , m_pinUnlocked{false}
+  , m_sessionRestoreTried{false}
   , m_sessionId{std::make_shared<std::string>()}
+  , m_transport{std::move(transport)}
+  , m_fileSystem{std::move(fileSystem)}
 {
-  kodi::Log(ADDON_LOG_INFO, "Loading ApiManager");
+  Log(LL_INFO, "Loading ApiManager (%s)", m_apiUrl.c_str());
 }
 
-std::string ApiManager::call(const std::string & urlPath, const ApiParams_t & paramsMap, bool putSessionVar) const
+std::string ApiManager::call(const std::string & urlPath, const ApiParams_t & paramsMap, bool putSessionVar, EndpointStats & stats) const
 {
   if (putSessionVar)
   {
@@ -194,39 +206,45 @@ std::string ApiManager::call(const std::string & urlPath, const ApiParams_t & pa
     if (session_id->empty())
       return std::string();
   }
+  TraceSpan span{stats.name, "api"};
   std::string url = urlPath;
   if (!paramsMap.empty())
   {
     url += '?';
     url += buildQueryString(paramsMap, putSessionVar);
   }
-  // add User-Agent header... TODO: make it configurable
-  url += "|User-Agent=okhttp%2F3.12.0";
   std::string response;
-
-  kodi::vfs::CFile fh;
-  if (fh.OpenFile(url, ADDON_READ_NO_CACHE))
+  TransferInfo info;
+  const auto start = std::chrono::steady_clock::now();
+  // TODO: make the User-Agent configurable
+  const bool opened = m_transport->Get(url, "okhttp%2F3.12.0", response, info);
+  const auto total = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+  stats.total.Add(total);
+  m_stats.AddRecentCall(total, !opened);
+  stats.calls.fetch_add(1, std::memory_order_relaxed);
+  if (!opened)
   {
-    char buffer[1024];
-    while (int bytesRead = fh.Read(buffer, 1024))
-      response.append(buffer, bytesRead);
-  }
-  else
+    stats.transportErrors.fetch_add(1, std::memory_order_relaxed);
+    Log(LL_ERROR, "Cannot open url");
+  } else
   {
-    kodi::Log(ADDON_LOG_ERROR, "Cannot open url");
+    if (0 <= info.firstByte.count())
+      stats.firstByte.Add(info.firstByte.count());
+    stats.bytes.Add(response.size());
   }
 
   return response;
 }
 
-std::string ApiManager::apiCall(const std::string &function, const ApiParams_t & paramsMap, bool putSessionVar /*= true*/) const
+ApiManager::ApiResponse ApiManager::apiCall(const std::string &function, const ApiParams_t & paramsMap, bool putSessionVar /*= true*/) const
 {
-  std::string url = API_URL[m_serviceProvider];
+  std::string url = m_apiUrl;
   url += function;
-  return call(url, paramsMap, putSessionVar);
+  EndpointStats & stats = m_stats.Endpoint(function);
+  return ApiResponse{call(url, paramsMap, putSessionVar, stats), &stats, &m_stats};
 }
 
-bool ApiManager::isSuccess(const std::string &response, Json::Value & root)
+ApiManager::ResponseStatus_t ApiManager::checkResponse(const std::string &response, Json::Value & root)
 {
   std::string jsonReaderError;
   Json::CharReaderBuilder jsonReaderBuilder;
@@ -236,20 +254,97 @@ bool ApiManager::isSuccess(const std::string &response, Json::Value & root)
   {
     bool success = root.get("status", 0).asInt() == 1;
     if (!success)
-      kodi::Log(ADDON_LOG_ERROR, "Error indicated in response. status: %d, error: %s", root.get("status", 0).asInt(), root.get("error", "").asString().c_str());
-    return success;
+      Log(LL_ERROR, "Error indicated in response. status: %d, error: %s", root.get("status", 0).asInt(), root.get("error", "").asString().c_str());
+    return success ? RS_SUCCESS : RS_STATUS_ERROR;
   }
 
-  kodi::Log(ADDON_LOG_ERROR, "Error parsing response. Response is: %*s, reader error: %s", std::min(response.size(), static_cast<size_t>(1024)), response.c_str(), jsonReaderError.c_str());
-  return false;
+  Log(LL_ERROR, "Error parsing response. Response is: %.*s, reader error: %s", static_cast<int>(std::min(response.size(), static_cast<size_t>(1024))), response.c_str(), jsonReaderError.c_str());
+  return RS_PARSE_ERROR;
+}
+
+bool ApiManager::isSuccess(const std::string &response, Json::Value & root)
+{
+  return RS_SUCCESS == checkResponse(response, root);
+}
+
+bool ApiManager::isSuccess(const ApiResponse &response, Json::Value & root)
+{
+  // the failed transfers are accounted by call()
+  if (nullptr == response.stats || response.body.empty())
+    return isSuccess(response.body, root);
+
+  TraceSpan span{"parse", "api"};
+  const auto start = std::chrono::steady_clock::now();
+  const ResponseStatus_t status = checkResponse(response.body, root);
+  response.stats->parse.Add(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+  switch (status)
+  {
+    case RS_PARSE_ERROR:
+      response.stats->parseErrors.fetch_add(1, std::memory_order_relaxed);
+      response.apiStats->AddRecentError();
+      break;
+    case RS_STATUS_ERROR:
+      response.stats->statusErrors.fetch_add(1, std::memory_order_relaxed);
+      response.apiStats->AddRecentError();
+      break;
+    default:
+      break;
+  }
+  return RS_SUCCESS == status;
 }
 
-bool ApiManager::isSuccess(const std::string &response)
+bool ApiManager::isSuccess(const ApiResponse &response)
 {
   Json::Value root;
   return isSuccess(response, root);
 }
 
+ApiManager::Fingerprint_t ApiManager::computeFingerprint(const std::string &response)
+{
+  // FNV-1a hash of the whole body
+  Fingerprint_t hash = 14695981039346656037ull;
+  for (const unsigned char c : response)
+  {
+    hash ^= c;
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+bool ApiManager::isSuccessChanged(const ApiResponse &response, Json::Value & root, Fingerprint_t & fingerprint, const std::string & storeName /*= std::string{}*/) const
+{
+  const Fingerprint_t hash = computeFingerprint(response.body);
+
+  if (!response.body.empty() && hash == fingerprint)
+  {
+    response.stats->unchanged.fetch_add(1, std::memory_order_relaxed);
+    // rewrite the same body, the file time is the time of the last successful fetch (the stored data age)
+    if (!storeName.empty())
+      m_fileSystem->WriteFile(getInstanceFilePath(storeName), response.body);
+    return true;
+  }
+
+  if (!isSuccess(response, root))
+    return false;
+
+  fingerprint = hash;
+  if (!storeName.empty())
+    m_fileSystem->WriteFile(getInstanceFilePath(storeName), response.body);
+  return true;
+}
+
+bool ApiManager::readStoredResponse(const std::string & storeName, Json::Value & root, Fingerprint_t & fingerprint, time_t & storedTime) const
+{
+  const std::string path = getInstanceFilePath(storeName);
+  const std::string response = readPairFile(path);
+  if (response.empty() || !isSuccess(response, root))
+    return false;
+
+  storedTime = m_fileSystem->ModificationTime(path);
+  fingerprint = computeFingerprint(response);
+  return true;
+}
+
 bool ApiManager::deletePairing(const Json::Value & root)
 {
   // try to delete pairing
@@ -262,14 +357,14 @@ bool ApiManager::deletePairing(const Json::Value & root)
   params.emplace_back("deviceId", old_dev_id);
   params.emplace_back("password", old_password);
   params.emplace_back("unit", API_UNIT[m_serviceProvider]);
-  const std::string response = apiCall("delete-pairing", params, false);
+  const ApiResponse response = apiCall("delete-pairing", params, false);
   Json::Value del_root;
   if (isSuccess(response, del_root)
       || (del_root.get("error", "").asString() == "no device")
       || (del_root.get("error", "").asString() == "not logged")
       )
   {
-    kodi::Log(ADDON_LOG_INFO, "Previous pairing(deviceId:%s) deleted (or no such device)", old_dev_id.c_str());
+    Log(LL_INFO, "Previous pairing(deviceId:%s) deleted (or no such device)", old_dev_id.c_str());
     return true;
   }
 
@@ -279,7 +374,7 @@ bool ApiManager::deletePairing(const Json::Value & root)
 bool ApiManager::pairDevice(Json::Value & root)
 {
   bool new_pairing = false;
-  std::string pairJson = readPairFile(getPairFilePath());
+  ApiResponse pairing{readPairFile(getPairFilePath()), nullptr, nullptr};
 
   std::string macAddr = m_overridenMac.empty() ? get_mac_address() : m_overridenMac;
   if (macAddr.empty())
@@ -287,13 +382,13 @@ bool ApiManager::pairDevice(Json::Value & root)
     std::ostringstream os;
     os << std::chrono::high_resolution_clock::now().time_since_epoch().count();
     macAddr = os.str();
-    kodi::Log(ADDON_LOG_INFO, "Unable to get MAC address, using a dummy(%s) for serial", macAddr.c_str());
+    Log(LL_INFO, "Unable to get MAC address, using a dummy(%s) for serial", macAddr.c_str());
   }
   // compute SHA256 of string representation of MAC address
   m_serial = picosha2::hash256_hex_string(macAddr);
 
 
-  if (pairJson.empty() || !isSuccess(pairJson, root)
+  if (pairing.body.empty() || !isSuccess(pairing.body, root)
       || root.get("userName", "").asString() != m_userName
       || root.get("serial", "").asString() != m_serial
       )
@@ -321,10 +416,10 @@ bool ApiManager::pairDevice(Json::Value & root)
     params.emplace_back("unit", API_UNIT[m_serviceProvider]);
     params.emplace_back("checkLimit", "1");
 
-    pairJson = apiCall("create-pairing", params, false);
+    pairing = apiCall("create-pairing", params, false);
   }
 
-  if (isSuccess(pairJson, root))
+  if (isSuccess(pairing, root))
   {
     int devId = root.get("deviceId", 0).asInt();
     std::string passwd = root.get("password", "").asString();
@@ -334,7 +429,7 @@ bool ApiManager::pairDevice(Json::Value & root)
     m_deviceId = buf;
     m_password = passwd;
 
-    kodi::Log(ADDON_LOG_DEBUG, "Device ID: %d, Password: %s", devId, passwd.c_str());
+    LOG_DEBUG("Device ID: %d, Password: %s", devId, passwd.c_str());
 
     const bool paired = !m_deviceId.empty() && !m_password.empty();
 
@@ -349,7 +444,7 @@ bool ApiManager::pairDevice(Json::Value & root)
   }
   else
   {
-    kodi::Log(ADDON_LOG_ERROR, "Error in pairing response.");
+    Log(LL_ERROR, "Error in pairing response.");
   }
 
   return false;
@@ -363,11 +458,19 @@ bool ApiManager::login()
   {
     if (!pairDevice(pairing_root))
     {
-      kodi::Log(ADDON_LOG_ERROR, "Cannot pair device");
+      Log(LL_ERROR, "Cannot pair device");
       return false;
     }
   }
 
+  if (!m_sessionRestoreTried)
+  {
+    // try the session from previous run just once (on startup)
+    m_sessionRestoreTried = true;
+    if (restoreSession())
+      return true;
+  }
+
   ApiParams_t param;
   param.emplace_back("deviceId", m_deviceId);
   param.emplace_back("password", m_password);
@@ -378,21 +481,21 @@ bool ApiManager::login()
   Json::Value root;
 
   std::string new_session_id;
-  const std::string response = apiCall("device-login", param, false);
+  const ApiResponse response = apiCall("device-login", param, false);
   if (isSuccess(response, root))
   {
     new_session_id = root.get("PHPSESSID", "").asString();
 
     if (new_session_id.empty())
     {
-      kodi::Log(ADDON_LOG_ERROR, "Cannot perform device login");
+      Log(LL_ERROR, "Cannot perform device login");
     }
     else
     {
-      kodi::Log(ADDON_LOG_INFO, "Device logged in. Session ID: %s", new_session_id.c_str());
+      Log(LL_INFO, "Device logged in. Session ID: %s", new_session_id.c_str());
     }
-  } else if (response.empty()) {
-    kodi::Log(ADDON_LOG_INFO, "No login response. Is something wrong with network or remote servers?");
+  } else if (response.body.empty()) {
+    Log(LL_INFO, "No login response. Is something wrong with network or remote servers?");
     // don't do anything, let the state as is to give it another try
     return false;
   }
@@ -408,33 +511,94 @@ bool ApiManager::login()
   }
 
   std::atomic_store(&m_sessionId, std::make_shared<const std::string>(std::move(new_session_id)));
+  if (success)
+    storeSession();
 
   return success;
 }
 
+bool ApiManager::restoreSession()
+{
+  Json::Value root;
+  const std::string content = readPairFile(getInstanceFilePath(SESSION_FILE));
+  if (content.empty() || !isSuccess(content, root))
+    return false;
+
+  const std::string session_id = root.get("PHPSESSID", "").asString();
+  if (session_id.empty() || root.get("deviceId", "").asString() != m_deviceId)
+    return false;
+
+  std::atomic_store(&m_sessionId, std::make_shared<const std::string>(session_id));
+  if (!keepAlive())
+  {
+    Log(LL_INFO, "Stored session is not valid anymore");
+    std::atomic_store(&m_sessionId, std::make_shared<const std::string>());
+    return false;
+  }
+
+  Log(LL_INFO, "Reusing stored session. Session ID: %s", session_id.c_str());
+  return true;
+}
+
+void ApiManager::storeSession() const
+{
+  Json::Value root;
+  // Note: the "status" is needed to pass the isSuccess() check on reading
+  root["status"] = 1;
+  root["deviceId"] = m_deviceId;
+  root["PHPSESSID"] = *std::atomic_load(&m_sessionId);
+  writeJsonFile(getInstanceFilePath(SESSION_FILE), root);
+}
+
 bool ApiManager::registerDrm(std::string & licenseUrl, std::string & certificate) const
 {
+  const std::string drm_file = getInstanceFilePath(DRM_FILE);
+  Json::Value stored;
+  const std::string content = readPairFile(drm_file);
+  if (!content.empty() && isSuccess(content, stored)
+      && stored.get("deviceId", "").asString() == m_deviceId
+      && stored.get("expires", 0).asInt64() > time(nullptr))
+  {
+    licenseUrl = stored.get("licenseUrl", "").asString();
+    certificate = base64::from_base64(stored.get("certificate", "").asString());
+    if (!licenseUrl.empty() && !certificate.empty())
+    {
+      LOG_DEBUG("Using stored DRM registration");
+      return true;
+    }
+  }
+
   ApiParams_t param;
   param.emplace_back("type", "widevine");
 
-  const std::string response = apiCall("drm-registration", param, true);
+  const ApiResponse response = apiCall("drm-registration", param, true);
   Json::Value root;
   if (!isSuccess(response, root))
       return false;
 
   const Json::Value & info = const_cast<const Json::Value &>(root)["info"];
   if (info["type"].asString() != "widevine")
-      kodi::Log(ADDON_LOG_WARNING, "Expected DRM type widevine, got %s. DRM may not work", info["type"].asString().c_str());
+      Log(LL_WARNING, "Expected DRM type widevine, got %s. DRM may not work", info["type"].asString().c_str());
   if (info["licenseHandler"]["requestEncoding"].asString() != "binary")
-      kodi::Log(ADDON_LOG_WARNING, "Expected DRM requestEncoding binary, got %s. DRM may not work", info["licenseHandler"]["requestEncoding"].asString().c_str());
+      Log(LL_WARNING, "Expected DRM requestEncoding binary, got %s. DRM may not work", info["licenseHandler"]["requestEncoding"].asString().c_str());
   if (info["licenseHandler"]["responseEncoding"].asString() != "binary")
-      kodi::Log(ADDON_LOG_WARNING, "Expected DRM responseEncoding binary, got %s. DRM may not work", info["licenseHandler"]["responseEncoding"].asString().c_str());
+      Log(LL_WARNING, "Expected DRM responseEncoding binary, got %s. DRM may not work", info["licenseHandler"]["responseEncoding"].asString().c_str());
   licenseUrl = info["licenseUrl"].asString();
   if (info["licenseUrl"].empty())
-      kodi::Log(ADDON_LOG_WARNING, "Got empty DRM licenseUrl. DRM may not work");
-  certificate = call(info["certificateUrl"].asString(), ApiParams_t{}, false);
+      Log(LL_WARNING, "Got empty DRM licenseUrl. DRM may not work");
+  certificate = call(info["certificateUrl"].asString(), ApiParams_t{}, false, m_stats.Endpoint("drm-certificate"));
   if (certificate.empty())
-      kodi::Log(ADDON_LOG_WARNING, "Got empty DRM certificate from %s. DRM may not work", info["certificateUrl"].asString().c_str());
+      Log(LL_WARNING, "Got empty DRM certificate from %s. DRM may not work", info["certificateUrl"].asString().c_str());
+  else
+  {
+    stored = Json::Value{Json::objectValue};
+    stored["status"] = 1;
+    stored["deviceId"] = m_deviceId;
+    stored["licenseUrl"] = licenseUrl;
+    stored["certificate"] = base64::to_base64(certificate);
+    stored["expires"] = static_cast<Json::Int64>(time(nullptr) + DRM_CACHE_TTL);
+    writeJsonFile(drm_file, stored);
+  }
   return true;
 }
 
@@ -454,7 +618,7 @@ bool ApiManager::pinUnlocked() const
   return m_pinUnlocked;
 }
 
-bool ApiManager::getPlaylist(StreamQuality_t quality, bool useH265, bool useAdaptive, Json::Value & root)
+bool ApiManager::getPlaylist(StreamQuality_t quality, bool useH265, bool useAdaptive, Json::Value & root, Fingerprint_t & fingerprint)
 {
   ApiParams_t params;
   params.emplace_back("uuid", m_serial);
@@ -468,7 +632,13 @@ bool ApiManager::getPlaylist(StreamQuality_t quality, bool useH265, bool useAdap
   params.emplace_back("capabilities", std::move(caps));
   params.emplace_back("drm", "widevine");
   params.emplace_back("subtitles", "1");
-  return isSuccess(apiCall("playlist", params), root);
+  // Note: the PIN-unlocked playlist isn't stored, the locked channels would be restored unlocked on the next start
+  return isSuccessChanged(apiCall("playlist", params), root, fingerprint, m_pinUnlocked ? std::string{} : STORED_PLAYLIST);
+}
+
+bool ApiManager::getStoredPlaylist(Json::Value & root, Fingerprint_t & fingerprint, time_t & storedTime) const
+{
+  return readStoredResponse(STORED_PLAYLIST, root, fingerprint, storedTime);
 }
 
 bool ApiManager::getStreamQualities(Json::Value & root)
@@ -476,7 +646,7 @@ bool ApiManager::getStreamQualities(Json::Value & root)
     return isSuccess(apiCall("get-stream-qualities", ApiParams_t{}), root);
 }
 
-bool ApiManager::getEpg(time_t start, bool smallDuration, const std::string & channels, Json::Value & root)
+bool ApiManager::getEpg(time_t start, bool smallDuration, const std::string & channels, Json::Value & root, Fingerprint_t & fingerprint)
 {
   ApiParams_t params;
 
@@ -487,12 +657,18 @@ bool ApiManager::getEpg(time_t start, bool smallDuration, const std::string & ch
   if (!channels.empty())
     params.emplace_back("channels", std::move(channels));
 
-  return isSuccess(apiCall("epg", params), root);
+  return isSuccessChanged(apiCall("epg", params), root, fingerprint);
+}
+
+bool ApiManager::getPvr(Json::Value & root, Fingerprint_t & fingerprint)
+{
+  // Note: the PIN-unlocked records aren't stored (as the playlist), see getPlaylist()
+  return isSuccessChanged(apiCall("get-pvr", ApiParams_t()), root, fingerprint, m_pinUnlocked ? std::string{} : STORED_PVR);
 }
 
-bool ApiManager::getPvr(Json::Value & root)
+bool ApiManager::getStoredPvr(Json::Value & root, Fingerprint_t & fingerprint, time_t & storedTime) const
 {
-  return isSuccess(apiCall("get-pvr", ApiParams_t()), root);
+  return readStoredResponse(STORED_PVR, root, fingerprint, storedTime);
 }
 
 std::string ApiManager::getRecordingUrl(const std::string &recId, std::string & channel, bool & isDrm)
@@ -564,6 +740,11 @@ bool ApiManager::keepAlive()
     return isSuccess(apiCall("keepalive", param));
 }
 
+const ApiStats & ApiManager::stats() const
+{
+  return m_stats;
+}
+
 bool ApiManager::loggedIn() const
 {
   auto session_id = std::atomic_load(&m_sessionId);
@@ -591,7 +772,7 @@ std::string ApiManager::urlEncode(const std::string &str)
 
 std::string ApiManager::buildQueryString(const ApiParams_t & paramMap, bool putSessionVar) const
 {
-  kodi::Log(ADDON_LOG_DEBUG, "%s - size %d", __FUNCTION__, paramMap.size());
+  LOG_TRACE("%s - size %d", __FUNCTION__, static_cast<int>(paramMap.size()));
   std::string strOut;
   for (const auto & param : paramMap)
   {
@@ -613,40 +794,39 @@ std::string ApiManager::buildQueryString(const ApiParams_t & paramMap, bool putS
   return strOut;
 }
 
-std::string ApiManager::getPairFilePath() const
+std::string ApiManager::getInstanceFilePath(const std::string & name) const
 {
   std::ostringstream os;
-  os << PAIR_FILE << '-' << m_instanceNo;
-  return kodi::addon::GetUserPath(os.str());
+  os << name << '-' << m_instanceNo;
+  return m_fileSystem->UserPath(os.str());
+}
+
+std::string ApiManager::getPairFilePath() const
+{
+  return getInstanceFilePath(PAIR_FILE);
 }
 
-std::string ApiManager::readPairFile(const std::string & pairFile)
+std::string ApiManager::readPairFile(const std::string & pairFile) const
 {
   std::string strContent;
 
-  kodi::Log(ADDON_LOG_DEBUG, "Openning file %s", pairFile.c_str());
+  LOG_DEBUG("Openning file %s", pairFile.c_str());
 
-  kodi::vfs::CFile fileHandle;
-  if (fileHandle.OpenFile(pairFile, 0))
-  {
-    char buffer[1024];
-    while (int bytesRead = fileHandle.Read(buffer, 1024))
-    strContent.append(buffer, bytesRead);
-  }
+  m_fileSystem->ReadFile(pairFile, strContent);
 
   return strContent;
 }
 
 void ApiManager::createPairFile(Json::Value & contentRoot) const
 {
-  kodi::vfs::CFile fileHandle;
-  if (fileHandle.OpenFileForWrite(getPairFilePath(), true))
-  {
-    std::ostringstream os;
-    os << contentRoot;
-    const std::string & content = os.str();
-    fileHandle.Write(content.c_str(), content.length());
-  }
+  writeJsonFile(getPairFilePath(), contentRoot);
+}
+
+void ApiManager::writeJsonFile(const std::string & path, const Json::Value & contentRoot) const
+{
+  std::ostringstream os;
+  os << contentRoot;
+  m_fileSystem->WriteFile(path, os.str());
 }
 
 } // namespace sledovanitvcz
@@ -30,6 +30,9 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <cstdint>
+#include "Platform.h"
+#include "ApiStats.h"
 
 namespace Json
 {
@@ -57,6 +60,11 @@ public:
       , SP_MODERNITV_CZ = 1
       , SP_END
   };
+  /*!
+   * \brief Fingerprint (hash) of a raw response body, used to detect
+   * unchanged responses without parsing them.
+   */
+  typedef uint64_t Fingerprint_t;
 public:
   static std::string formatTime(time_t t);
   static std::string urlEncode(const std::string &str);
@@ -67,15 +75,29 @@ public:
       , const std::string & userPassword
       , const std::string & overridenMac //!< device identifier (value for overriding the MAC address detection)
       , const std::string & product //!< product identifier (value for overriding the hostname detection)
+      , const std::string & apiUrl //!< base URL of the API (value for overriding the service provider's one, e.g. a mock server)
       , uint64_t instanceNo
+      , std::shared_ptr<Transport> transport
+      , std::shared_ptr<FileSystem> fileSystem
       );
 
   bool login();
   bool pinUnlock(const std::string & pin);
-  bool getPlaylist(StreamQuality_t quality, bool useH265, bool useAdaptive, Json::Value & root);
+  /*!
+   * \note The \param fingerprint is the in/out parameter. On input the fingerprint
+   * of the last applied response, on output the fingerprint of the received one.
+   * If these are equal the response is not parsed (the \param root is untouched).
+   */
+  bool getPlaylist(StreamQuality_t quality, bool useH265, bool useAdaptive, Json::Value & root, Fingerprint_t & fingerprint);
+  //! Get the playlist stored by the last successful getPlaylist() (without any network call)
+  bool getStoredPlaylist(Json::Value & root, Fingerprint_t & fingerprint, time_t & storedTime) const;
   bool getStreamQualities(Json::Value & root);
-  bool getEpg(time_t start, bool smallDuration, const std::string & channels, Json::Value & root);
-  bool getPvr(Json::Value & root);
+  //! \note see getPlaylist() for \param fingerprint
+  bool getEpg(time_t start, bool smallDuration, const std::string & channels, Json::Value & root, Fingerprint_t & fingerprint);
+  //! \note see getPlaylist() for \param fingerprint
+  bool getPvr(Json::Value & root, Fingerprint_t & fingerprint);
+  //! Get the recordings stored by the last successful getPvr() (without any network call)
+  bool getStoredPvr(Json::Value & root, Fingerprint_t & fingerprint, time_t & storedTime) const;
   std::string getRecordingUrl(const std::string &recId, std::string & channel, bool & isDrm);
   bool getTimeShiftInfo(const std::string &eventId
       , std::string & streamUrl
@@ -86,35 +108,73 @@ public:
   bool keepAlive();
   bool loggedIn() const;
   bool pinUnlocked() const;
+  //! \note the registration is stored (for some time) and reused
   bool registerDrm(std::string & licenseUrl, std::string & certificate) const;
+  //! Statistics of the API calls (since the construction)
+  const ApiStats & stats() const;
 
 private:
-  static std::string readPairFile(const std::string & pairFile);
+  enum ResponseStatus_t
+  {
+    RS_SUCCESS
+      , RS_STATUS_ERROR
+      , RS_PARSE_ERROR
+  };
+  //! Response of the API function with its statistics (nullptr for stored responses)
+  struct ApiResponse
+  {
+    std::string body;
+    EndpointStats * stats;
+    ApiStats * apiStats; //!< the owner of the \a stats
+  };
+
+  std::string readPairFile(const std::string & pairFile) const;
+  void writeJsonFile(const std::string & path, const Json::Value & contentRoot) const;
+  static ResponseStatus_t checkResponse(const std::string &response, Json::Value & root);
   static bool isSuccess(const std::string &response, Json::Value & root);
-  static bool isSuccess(const std::string &response);
+  //! \note records the parsing time and errors into the response statistics
+  static bool isSuccess(const ApiResponse &response, Json::Value & root);
+  static bool isSuccess(const ApiResponse &response);
+  static Fingerprint_t computeFingerprint(const std::string &response);
+  //! \param storeName if not empty, the successful response is stored under this name (rewritten also if unchanged)
+  bool isSuccessChanged(const ApiResponse &response, Json::Value & root, Fingerprint_t & fingerprint, const std::string & storeName = std::string{}) const;
+  bool readStoredResponse(const std::string & storeName, Json::Value & root, Fingerprint_t & fingerprint, time_t & storedTime) const;
 
   std::string buildQueryString(const ApiParams_t & paramMap, bool putSessionVar) const;
-  std::string call(const std::string & urlPath, const ApiParams_t & paramsMap, bool putSessionVar) const;
-  std::string apiCall(const std::string &function, const ApiParams_t & paramsMap, bool putSessionVar = true) const;
+  std::string call(const std::string & urlPath, const ApiParams_t & paramsMap, bool putSessionVar, EndpointStats & stats) const;
+  ApiResponse apiCall(const std::string &function, const ApiParams_t & paramsMap, bool putSessionVar = true) const;
   bool pairDevice(Json::Value & root);
   bool deletePairing(const Json::Value & root);
+  std::string getInstanceFilePath(const std::string & name) const;
   std::string getPairFilePath() const;
   void createPairFile(Json::Value & contentRoot) const;
+  //! Try to reuse the session stored by the previous run (validated by keepalive call)
+  bool restoreSession();
+  void storeSession() const;
 
   static const std::string API_URL[SP_END];
   static const std::string API_UNIT[SP_END];
   static const std::string PAIR_FILE;
+  static const std::string SESSION_FILE;
+  static const std::string DRM_FILE;
+  static const std::string STORED_PLAYLIST;
+  static const std::string STORED_PVR;
   const ServiceProvider_t m_serviceProvider;
   const std::string m_userName;
   const std::string m_userPassword;
   const std::string m_overridenMac;
   const std::string m_product;
+  const std::string m_apiUrl;
   const uint64_t m_instanceNo;
   std::string m_serial;
   std::string m_deviceId;
   std::string m_password;
   bool m_pinUnlocked;
+  bool m_sessionRestoreTried;
   std::shared_ptr<const std::string> m_sessionId;
+  const std::shared_ptr<Transport> m_transport;
+  const std::shared_ptr<FileSystem> m_fileSystem;
+  mutable ApiStats m_stats;
 };
 
 } // namespace sledovanitvcz
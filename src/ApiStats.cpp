@@ -0,0 +1,212 @@
+/*
+ *      Copyright (c) 2018~now Palo Kisa <palo.kisa@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this addon; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include "ApiStats.h"
+#include <algorithm>
+#include <cstdio>
+
+namespace sledovanitvcz
+{
+
+constexpr unsigned Histogram::BUCKETS;
+constexpr unsigned ApiStats::ENDPOINTS;
+constexpr uint64_t ApiStats::RECENT_WEIGHT;
+constexpr uint64_t ApiStats::RECENT_ERROR_SCALE;
+
+//! Add the \param sample into the moving average \param average (the weight 1/\param weight)
+static void AddToAverage(std::atomic<uint64_t> & average, uint64_t sample, uint64_t weight)
+{
+  uint64_t value = average.load(std::memory_order_relaxed);
+  while (!average.compare_exchange_weak(value, value - value / weight + sample / weight, std::memory_order_relaxed))
+    ;
+}
+
+Histogram::Histogram()
+  : m_count{0}
+  , m_sum{0}
+  , m_max{0}
+{
+  for (auto & bucket : m_buckets)
+    bucket.store(0, std::memory_order_relaxed);
+}
+
+void Histogram::Add(uint64_t value)
+{
+  unsigned bucket = 0;
+  for (uint64_t v = value; 0 != v && bucket < BUCKETS - 1; v >>= 1)
+    ++bucket;
+  m_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+  m_count.fetch_add(1, std::memory_order_relaxed);
+  m_sum.fetch_add(value, std::memory_order_relaxed);
+  uint64_t max = m_max.load(std::memory_order_relaxed);
+  while (max < value && !m_max.compare_exchange_weak(max, value, std::memory_order_relaxed))
+    ;
+}
+
+uint64_t Histogram::Count() const
+{
+  return m_count.load(std::memory_order_relaxed);
+}
+
+uint64_t Histogram::Sum() const
+{
+  return m_sum.load(std::memory_order_relaxed);
+}
+
+uint64_t Histogram::Max() const
+{
+  return m_max.load(std::memory_order_relaxed);
+}
+
+uint64_t Histogram::Quantile(double quantile) const
+{
+  const uint64_t count = Count();
+  if (0 == count)
+    return 0;
+  const uint64_t rank = static_cast<uint64_t>(quantile * (count - 1)) + 1;
+  uint64_t seen = 0;
+  for (unsigned bucket = 0; bucket < BUCKETS; ++bucket)
+  {
+    seen += m_buckets[bucket].load(std::memory_order_relaxed);
+    if (seen >= rank)
+      return std::min((uint64_t{1} << bucket) - 1, Max());
+  }
+  return Max();
+}
+
+ApiStats::ApiStats()
+  : m_endpoints{
+    {"create-pairing"}
+    , {"delete-pairing"}
+    , {"device-login"}
+    , {"keepalive"}
+    , {"pin-unlock"}
+    , {"drm-registration"}
+    , {"drm-certificate"}
+    , {"playlist"}
+    , {"get-stream-qualities"}
+    , {"epg"}
+    , {"get-pvr"}
+    , {"record-timeshift"}
+    , {"event-timeshift"}
+    , {"record-event"}
+    , {"delete-record"}
+    , {"other"}
+  }
+  , m_lastCall{0}
+  , m_recentCalls{0}
+  , m_recentTotal{0}
+  , m_recentErrors{0}
+{
+}
+
+EndpointStats & ApiStats::Endpoint(const std::string & function)
+{
+  for (unsigned i = 0; i < ENDPOINTS - 1; ++i)
+    if (function == m_endpoints[i].name)
+      return m_endpoints[i];
+  return m_endpoints[ENDPOINTS - 1];
+}
+
+const EndpointStats & ApiStats::Endpoint(unsigned index) const
+{
+  return m_endpoints[index];
+}
+
+std::string ApiStats::Report() const
+{
+  // times in [ms], the quantiles are the upper bounds of the histogram buckets
+  char line[256];
+  std::snprintf(line, sizeof (line), "%-20s %6s %6s %6s %6s %6s %9s %9s %6s %6s %6s %6s %10s %10s %8s %8s\n"
+      , "endpoint", "calls", "trans", "parse", "status", "unchgd", "avg[kB]", "max[kB]"
+      , "p50", "p90", "p99", "max", "1stbyte50", "1stbyte90", "parse50", "parse90");
+  std::string report = line;
+  for (const auto & endpoint : m_endpoints)
+  {
+    const uint64_t calls = endpoint.calls.load(std::memory_order_relaxed);
+    if (0 == calls)
+      continue;
+    std::snprintf(line, sizeof (line)
+        , "%-20s %6llu %6llu %6llu %6llu %6llu %9.1f %9.1f %6.0f %6.0f %6.0f %6.0f %10.0f %10.0f %8.1f %8.1f\n"
+        , endpoint.name
+        , static_cast<unsigned long long>(calls)
+        , static_cast<unsigned long long>(endpoint.transportErrors.load(std::memory_order_relaxed))
+        , static_cast<unsigned long long>(endpoint.parseErrors.load(std::memory_order_relaxed))
+        , static_cast<unsigned long long>(endpoint.statusErrors.load(std::memory_order_relaxed))
+        , static_cast<unsigned long long>(endpoint.unchanged.load(std::memory_order_relaxed))
+        , endpoint.bytes.Sum() / 1024.0 / (endpoint.bytes.Count() ? endpoint.bytes.Count() : 1)
+        , endpoint.bytes.Max() / 1024.0
+        , endpoint.total.Quantile(0.5) / 1000.0, endpoint.total.Quantile(0.9) / 1000.0
+        , endpoint.total.Quantile(0.99) / 1000.0, endpoint.total.Max() / 1000.0
+        , endpoint.firstByte.Quantile(0.5) / 1000.0, endpoint.firstByte.Quantile(0.9) / 1000.0
+        , endpoint.parse.Quantile(0.5) / 1000.0, endpoint.parse.Quantile(0.9) / 1000.0);
+    report += line;
+  }
+  return report;
+}
+
+void ApiStats::AddRecentCall(uint64_t total, bool failed)
+{
+  m_lastCall.store(total, std::memory_order_relaxed);
+  const uint64_t error = failed ? RECENT_ERROR_SCALE : 0;
+  if (0 == m_recentCalls.fetch_add(1, std::memory_order_relaxed))
+  {
+    // the first call starts the averages
+    m_recentTotal.store(total, std::memory_order_relaxed);
+    m_recentErrors.store(error, std::memory_order_relaxed);
+    return;
+  }
+  AddToAverage(m_recentTotal, total, RECENT_WEIGHT);
+  AddToAverage(m_recentErrors, error, RECENT_WEIGHT);
+}
+
+void ApiStats::AddRecentError()
+{
+  // the call was accounted as a successful one, move its share to the failures
+  uint64_t value = m_recentErrors.load(std::memory_order_relaxed);
+  while (!m_recentErrors.compare_exchange_weak(value, std::min(value + RECENT_ERROR_SCALE / RECENT_WEIGHT, RECENT_ERROR_SCALE), std::memory_order_relaxed))
+    ;
+}
+
+uint64_t ApiStats::LastCall() const
+{
+  return m_lastCall.load(std::memory_order_relaxed);
+}
+
+bool ApiStats::Recent(double & total, double & errorRatio) const
+{
+  total = static_cast<double>(m_recentTotal.load(std::memory_order_relaxed));
+  errorRatio = static_cast<double>(m_recentErrors.load(std::memory_order_relaxed)) / RECENT_ERROR_SCALE;
+  return 0 < m_recentCalls.load(std::memory_order_relaxed);
+}
+
+void ApiStats::Totals(uint64_t & calls, uint64_t & errors) const
+{
+  calls = errors = 0;
+  for (const auto & endpoint : m_endpoints)
+  {
+    calls += endpoint.calls.load(std::memory_order_relaxed);
+    errors += endpoint.transportErrors.load(std::memory_order_relaxed)
+      + endpoint.parseErrors.load(std::memory_order_relaxed)
+      + endpoint.statusErrors.load(std::memory_order_relaxed);
+  }
+}
+
+} // namespace sledovanitvcz
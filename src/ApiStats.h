@@ -0,0 +1,114 @@
+/*
+ *      Copyright (c) 2018~now Palo Kisa <palo.kisa@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this addon; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#ifndef sledovanitvcz_ApiStats_h
+#define sledovanitvcz_ApiStats_h
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/*!
+ * \file Per-endpoint statistics of the API calls (counters and log2 histograms).
+ * All the updates are lock-free (relaxed atomics), readers get a consistent
+ * enough view for the diagnostics.
+ */
+
+namespace sledovanitvcz
+{
+
+//! Histogram with log2 buckets: the bucket i holds values of bit width i
+class Histogram
+{
+public:
+  static constexpr unsigned BUCKETS = 40;
+
+  Histogram();
+  void Add(uint64_t value);
+  uint64_t Count() const;
+  uint64_t Sum() const;
+  uint64_t Max() const;
+  //! \return upper bound of the bucket holding the \param quantile (0..1)
+  uint64_t Quantile(double quantile) const;
+
+private:
+  std::atomic<uint64_t> m_buckets[BUCKETS];
+  std::atomic<uint64_t> m_count;
+  std::atomic<uint64_t> m_sum;
+  std::atomic<uint64_t> m_max;
+};
+
+struct EndpointStats
+{
+  const char * const name;
+  std::atomic<uint64_t> calls{0};
+  std::atomic<uint64_t> transportErrors{0}; //!< the url couldn't be opened
+  std::atomic<uint64_t> parseErrors{0}; //!< the response is not valid JSON
+  std::atomic<uint64_t> statusErrors{0}; //!< the response indicates an error (status != 1)
+  std::atomic<uint64_t> unchanged{0}; //!< the response was the same as the last applied one (not parsed)
+  Histogram firstByte; //!< [us] connect + the response headers (if known by the Transport)
+  Histogram total; //!< [us] whole transfer
+  Histogram bytes; //!< response size
+  Histogram parse; //!< [us] JSON parsing
+
+  EndpointStats(const char * endpointName) : name{endpointName} {}
+};
+
+class ApiStats
+{
+public:
+  //! The API functions (the last one collects unknown functions)
+  static constexpr unsigned ENDPOINTS = 16;
+
+  ApiStats();
+  //! \return the statistics of the \param function (the API function name)
+  EndpointStats & Endpoint(const std::string & function);
+  const EndpointStats & Endpoint(unsigned index) const;
+  //! \return the statistics formatted as the text table (one endpoint per line)
+  std::string Report() const;
+  //! Account the finished call (\param total [us], \param failed transfer) into the recent window
+  void AddRecentCall(uint64_t total, bool failed);
+  //! Account the failure of the last call found after the transfer (parse/status error)
+  void AddRecentError();
+  //! \return [us] the whole transfer time of the last finished call, 0 if none
+  uint64_t LastCall() const;
+  /*!
+   * \brief The recent window: exponentially weighted moving averages (the weight
+   * of the last call is 1/RECENT_WEIGHT) of the \param total [us] and of the
+   * \param errorRatio (0..1) of the calls
+   * \return false if there was no call yet
+   */
+  bool Recent(double & total, double & errorRatio) const;
+  //! Sums of all the endpoints: \param calls and the failed (transport, parse, status) \param errors
+  void Totals(uint64_t & calls, uint64_t & errors) const;
+
+private:
+  static constexpr uint64_t RECENT_WEIGHT = 16;
+  static constexpr uint64_t RECENT_ERROR_SCALE = 1 << 20; //!< the fixed point 1.0 of m_recentErrors
+
+  EndpointStats m_endpoints[ENDPOINTS];
+  std::atomic<uint64_t> m_lastCall;
+  std::atomic<uint64_t> m_recentCalls;
+  std::atomic<uint64_t> m_recentTotal; //!< [us] EWMA of the whole transfer time
+  std::atomic<uint64_t> m_recentErrors; //!< EWMA of the failures (in RECENT_ERROR_SCALE units)
+};
+
+} // namespace sledovanitvcz
+#endif // sledovanitvcz_ApiStats_h
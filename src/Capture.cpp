@@ -0,0 +1,165 @@
+/*
+ *      Copyright (c) 2018~now Palo Kisa <palo.kisa@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this addon; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include "Capture.h"
+#include "base64.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <sstream>
+
+namespace sledovanitvcz
+{
+
+static const std::string SCRUBBED = "scrubbed";
+static const char * const SENSITIVE_PARAMS[] = { "PHPSESSID", "password", "username", "pin" };
+static const char * const SENSITIVE_MEMBERS[] = { "PHPSESSID", "password" };
+
+std::string ScrubUrl(const std::string & url)
+{
+  std::string result = url;
+  for (const std::string param : SENSITIVE_PARAMS)
+  {
+    const std::string key = param + '=';
+    for (size_t pos = result.find(key); std::string::npos != pos; pos = result.find(key, pos + 1))
+    {
+      // just whole parameter names
+      if (0 == pos || (result[pos - 1] != '?' && result[pos - 1] != '&'))
+        continue;
+      const size_t value = pos + key.size();
+      const size_t end = result.find('&', value);
+      result.replace(value, std::string::npos == end ? std::string::npos : end - value, SCRUBBED);
+    }
+  }
+  return result;
+}
+
+std::string ScrubResponse(const std::string & response)
+{
+  std::string result = response;
+  for (const std::string member : SENSITIVE_MEMBERS)
+  {
+    const std::string key = '"' + member + '"';
+    for (size_t pos = result.find(key); std::string::npos != pos; pos = result.find(key, pos))
+    {
+      pos += key.size();
+      const size_t value = result.find_first_not_of(" \t\r\n:", pos);
+      if (std::string::npos == value || result[value] != '"' || result.find(':', pos) > value)
+        continue;
+      // the string value, respecting the escapes
+      size_t end = value + 1;
+      while (end < result.size() && result[end] != '"')
+        end += result[end] == '\\' ? 2 : 1;
+      if (end >= result.size())
+        break;
+      result.replace(value + 1, end - value - 1, SCRUBBED);
+    }
+  }
+  return result;
+}
+
+CaptureTransport::CaptureTransport(std::shared_ptr<Transport> transport, std::shared_ptr<FileSystem> fileSystem, std::string path)
+  : m_transport{std::move(transport)}
+  , m_fileSystem{std::move(fileSystem)}
+  , m_path{std::move(path)}
+{
+  Log(LL_INFO, "Capturing the API calls to %s", m_path.c_str());
+}
+
+bool CaptureTransport::Get(const std::string & url, const std::string & userAgent, std::string & response, TransferInfo & info)
+{
+  const time_t now = time(nullptr);
+  const auto start = std::chrono::steady_clock::now();
+  const bool success = m_transport->Get(url, userAgent, response, info);
+  const auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+  std::ostringstream line;
+  line << now << '\t' << duration << '\t' << (success ? 1 : 0) << '\t' << ScrubUrl(url)
+    << '\t' << base64::to_base64(ScrubResponse(response)) << '\n';
+  std::lock_guard<std::mutex> critical(m_mutex);
+  if (!m_fileSystem->AppendFile(m_path, line.str()))
+    Log(LL_WARNING, "Cannot append to the capture file %s", m_path.c_str());
+  return success;
+}
+
+ReplayCaptureTransport::ReplayCaptureTransport(const std::shared_ptr<FileSystem> & fileSystem, const std::string & path)
+{
+  std::string content;
+  if (!fileSystem->ReadFile(path, content))
+  {
+    Log(LL_ERROR, "Cannot read the capture file %s", path.c_str());
+    return;
+  }
+  std::istringstream lines{content};
+  std::string line;
+  size_t count = 0;
+  while (std::getline(lines, line))
+  {
+    std::istringstream fields{line};
+    Call call;
+    std::string success, response;
+    if (!(fields >> call.time >> call.duration >> success)
+        || !std::getline(fields.ignore(), call.url, '\t')
+        || !std::getline(fields, response))
+    {
+      Log(LL_WARNING, "Skipping malformed capture line %u", static_cast<unsigned>(count + 1));
+      continue;
+    }
+    call.success = success == "1";
+    call.response = base64::from_base64(response);
+    m_calls[Function(call.url)].push_back(std::move(call));
+    ++count;
+  }
+  Log(LL_INFO, "Replaying %u captured API calls from %s", static_cast<unsigned>(count), path.c_str());
+}
+
+bool ReplayCaptureTransport::Get(const std::string & url, const std::string & /*userAgent*/, std::string & response, TransferInfo & /*info*/)
+{
+  const std::string function = Function(url);
+  std::lock_guard<std::mutex> critical(m_mutex);
+  const auto calls_i = m_calls.find(function);
+  if (m_calls.cend() == calls_i)
+  {
+    Log(LL_WARNING, "No captured call of %s", function.c_str());
+    return false;
+  }
+  size_t & next = m_next[function];
+  const Call & call = calls_i->second[std::min(next, calls_i->second.size() - 1)];
+  ++next;
+  response = call.response;
+  return call.success;
+}
+
+size_t ReplayCaptureTransport::Count(const std::string & function) const
+{
+  std::lock_guard<std::mutex> critical(m_mutex);
+  const auto calls_i = m_calls.find(function);
+  return m_calls.cend() == calls_i ? 0 : calls_i->second.size();
+}
+
+std::string ReplayCaptureTransport::Function(const std::string & url)
+{
+  const size_t query = url.find('?');
+  const size_t slash = url.rfind('/', query);
+  const size_t begin = std::string::npos == slash ? 0 : slash + 1;
+  return url.substr(begin, std::string::npos == query ? std::string::npos : query - begin);
+}
+
+} // namespace sledovanitvcz
@@ -0,0 +1,101 @@
+/*
+ *      Copyright (c) 2018~now Palo Kisa <palo.kisa@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this addon; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#ifndef sledovanitvcz_Capture_h
+#define sledovanitvcz_Capture_h
+
+#include "Platform.h"
+#include <map>
+#include <mutex>
+#include <vector>
+
+/*!
+ * \file Capture of the API traffic (the requests and the raw responses
+ * going through ApiManager::call()) and its replay.
+ *
+ * The capture file is append-only, one call per line:
+ *   <unix time>\t<duration [ms]>\t<success 0/1>\t<url>\t<base64 of the response>
+ * The session id and the credentials are scrubbed from both the urls
+ * and the responses.
+ */
+
+namespace sledovanitvcz
+{
+
+enum CaptureMode_t
+{
+  CM_OFF = 0
+    , CM_CAPTURE
+    , CM_REPLAY
+};
+
+//! \return the \p url with the values of the sensitive parameters replaced
+std::string ScrubUrl(const std::string & url);
+//! \return the \p response with the values of the sensitive JSON members replaced
+std::string ScrubResponse(const std::string & response);
+
+//! Writes every call of the wrapped transport to the capture file
+class CaptureTransport : public Transport
+{
+public:
+  CaptureTransport(std::shared_ptr<Transport> transport, std::shared_ptr<FileSystem> fileSystem, std::string path);
+
+  bool Get(const std::string & url, const std::string & userAgent, std::string & response, TransferInfo & info) override;
+
+private:
+  const std::shared_ptr<Transport> m_transport;
+  const std::shared_ptr<FileSystem> m_fileSystem;
+  const std::string m_path;
+  std::mutex m_mutex; //!< keeps the lines whole
+};
+
+//! Serves the calls from the capture file: the responses of every API
+//! function are served in the captured order, the last one is repeated
+class ReplayCaptureTransport : public Transport
+{
+public:
+  struct Call
+  {
+    time_t time;
+    int duration; //!< [ms]
+    bool success;
+    std::string url;
+    std::string response;
+  };
+
+  ReplayCaptureTransport(const std::shared_ptr<FileSystem> & fileSystem, const std::string & path);
+
+  bool Get(const std::string & url, const std::string & userAgent, std::string & response, TransferInfo & info) override;
+  //! \return count of the captured calls of the \p function
+  size_t Count(const std::string & function) const;
+
+  //! \return the API function name (the last path element) of the \p url
+  static std::string Function(const std::string & url);
+
+private:
+  //! function -> captured calls
+  std::map<std::string, std::vector<Call>> m_calls;
+  //! function -> next call to serve
+  std::map<std::string, size_t> m_next;
+  mutable std::mutex m_mutex;
+};
+
+} // namespace sledovanitvcz
+#endif // sledovanitvcz_Capture_h
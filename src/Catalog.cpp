@@ -0,0 +1,535 @@
+/*
+ *      Copyright (c) 2018~now Palo Kisa <palo.kisa@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this addon; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include "Catalog.h"
+#include "Platform.h"
+#include "ApiManager.h"
+#include <json/json.h>
+#include <cmath>
+#include <cstring>
+#include <cstdio>
+#include <memory>
+#include "kodi/c-api/addon-instance/pvr/pvr_channels.h"
+
+#if defined(TARGET_WINDOWS)
+# define LOCALTIME_R(src, dst) localtime_s(dst, src)
+# define GMTIME_R(src, dst) gmtime_s(dst, src)
+#else
+# define LOCALTIME_R(src, dst) localtime_r(src, dst)
+# define GMTIME_R(src, dst) gmtime_r(src, dst)
+#endif
+
+namespace sledovanitvcz
+{
+
+unsigned DiffBetweenUtcAndLocalTime(const time_t * when /*= nullptr*/, int * isdst /*= nullptr*/)
+{
+  time_t tloc;
+  if (0 == when)
+    time(&tloc);
+  else
+    tloc = *when;
+
+  struct tm tm1;
+  LOCALTIME_R(&tloc, &tm1);
+  auto l_isdst = tm1.tm_isdst;
+  if (isdst)
+    *isdst = l_isdst;
+  GMTIME_R(&tloc, &tm1);
+  tm1.tm_isdst = l_isdst;
+  time_t t2 = mktime(&tm1);
+
+  return tloc - t2;
+}
+
+static inline unsigned DiffBetweenPragueAndLocalTime(const time_t * when = nullptr)
+{
+  int isdst = -1;
+  auto diff =  DiffBetweenUtcAndLocalTime(when, &isdst);
+  // Note: Prague(Czech) is in Central Europe Time -> CET or CEST == UTC+1 or UTC+2 == +3600 or +7200
+  return diff - (isdst > 0 ? 7200 : 3600);
+}
+
+bool operator ==(const Recording & a, const Recording & b)
+{
+  return a.strRecordId == b.strRecordId
+    && a.strTitle == b.strTitle
+    && a.strPlotOutline == b.strPlotOutline
+    && a.strPlot == b.strPlot
+    && a.strChannelName == b.strChannelName
+    && a.startTime == b.startTime
+    && a.duration == b.duration
+    && a.strDirectory == b.strDirectory
+    && a.bRadio == b.bRadio
+    && a.iLifeTime == b.iLifeTime
+    && a.iChannelUid == b.iChannelUid
+    && a.bIsPinLocked == b.bIsPinLocked;
+}
+
+bool operator ==(const Timer & a, const Timer & b)
+{
+  // Note: compare only the members filled in LoadRecordings()
+  return a.iClientIndex == b.iClientIndex
+    && a.iClientChannelUid == b.iClientChannelUid
+    && a.startTime == b.startTime
+    && a.endTime == b.endTime
+    && a.state == b.state
+    && a.strTitle == b.strTitle
+    && a.iLifeTime == b.iLifeTime
+    && a.strDirectory == b.strDirectory;
+}
+
+void CacheStreamInfo(stream_info_cache_t & cache, const std::string & key, const StreamInfo & info, size_t maxSize, time_t now)
+{
+  if (cache.size() >= maxSize)
+  {
+    // drop expired entries, if not enough drop the oldest one
+    for (auto info_i = cache.begin(); info_i != cache.end(); )
+    {
+      if (now < info_i->second.expires)
+        ++info_i;
+      else
+        info_i = cache.erase(info_i);
+    }
+    if (cache.size() >= maxSize)
+      cache.erase(std::min_element(cache.cbegin(), cache.cend()
+            , [] (stream_info_cache_t::const_reference a, stream_info_cache_t::const_reference b) { return a.second.expires < b.second.expires; }));
+  }
+  cache[key] = info;
+}
+
+time_t ParseDateTime(const std::string & strDate)
+{
+  struct tm timeinfo;
+  memset(&timeinfo, 0, sizeof(tm));
+
+  sscanf(strDate.c_str(), "%04d-%02d-%02d %02d:%02d", &timeinfo.tm_year, &timeinfo.tm_mon, &timeinfo.tm_mday, &timeinfo.tm_hour, &timeinfo.tm_min);
+  timeinfo.tm_sec = 0;
+
+  timeinfo.tm_mon  -= 1;
+  timeinfo.tm_year -= 1900;
+  timeinfo.tm_isdst = -1;
+
+  time_t t = mktime(&timeinfo);
+  // Note: the diff is "unsigned", but can be negative
+  return t - static_cast<int>(DiffBetweenPragueAndLocalTime(&t));
+}
+
+bool ParseJson(const std::string & content, Json::Value & root)
+{
+  Json::CharReaderBuilder jsonReaderBuilder;
+  std::unique_ptr<Json::CharReader> const reader(jsonReaderBuilder.newCharReader());
+  return reader->parse(content.c_str(), content.c_str() + content.size(), &root, nullptr);
+}
+
+void ParsePlayList(const Json::Value & root
+    , bool showLockedChannels
+    , bool showLockedOnlyPin
+    , const std::function<int (const std::string & channelId)> & uniqueId
+    , channel_container_t & channels
+    , group_container_t & groups
+    , group_index_t & groupsIndex
+    )
+{
+  //channels
+  const Json::Value & json_channels = root["channels"];
+  for (unsigned int i = 0; i < json_channels.size(); i++)
+  {
+    const Json::Value & channel = json_channels[i];
+    const std::string locked = channel.get("locked", "none").asString();
+    if (locked != "none")
+    {
+      if (!showLockedChannels || (showLockedOnlyPin && locked != "pin"))
+      {
+        Log(LL_INFO, "Skipping locked(%s) channel#%u %s", locked.c_str(), i + 1, channel.get("name", "").asString().c_str());
+        continue;
+      }
+    }
+
+    Channel iptvchan;
+
+    iptvchan.strId = channel.get("id", "").asString();
+    iptvchan.strChannelName = channel.get("name", "").asString();
+    iptvchan.strGroupId = channel.get("group", "").asString();
+    iptvchan.strStreamURL = channel.get("url", "").asString();
+    iptvchan.strStreamType = channel.get("streamType", "").asString();
+    iptvchan.bIsDrm = channel.get("drm", "0").asInt() != 0;
+    iptvchan.iUniqueId = uniqueId(iptvchan.strId);
+    iptvchan.iChannelNumber = i + 1;
+    LOG_TRACE("Channel#%d %s, URL: %s", iptvchan.iUniqueId, iptvchan.strChannelName.c_str(), iptvchan.strStreamURL.c_str());
+    iptvchan.strIconPath = channel.get("logoUrl", "").asString();
+    iptvchan.bIsRadio = channel.get("type", "").asString() != "tv";
+    iptvchan.bIsPinLocked = locked == "pin";
+
+    channels.push_back(std::move(iptvchan));
+  }
+
+  std::unordered_map<std::string, size_t> group_id_index;
+  const Json::Value & json_groups = root["groups"];
+  for (const auto & group_id : json_groups.getMemberNames())
+  {
+    ChannelGroup group;
+    group.bRadio = false; // currently there is no way to distinguish group types in the returned json
+    group.strGroupId = group_id;
+    group.strGroupName = json_groups[group_id].asString();
+    group_id_index.emplace(group_id, groups.size());
+    groupsIndex.emplace(group.strGroupName, groups.size());
+    groups.push_back(std::move(group));
+  }
+  // assign channels into groups in one pass
+  for (const auto & channel : channels)
+  {
+    if (channel.bIsRadio)
+      continue;
+    const auto group_i = group_id_index.find(channel.strGroupId);
+    if (group_id_index.cend() != group_i)
+      groups[group_i->second].members.push_back(channel.iUniqueId);
+  }
+}
+
+void ParseEpgEntry(const Json::Value & epgEntry, int channelUid, EpgEntry & entry, std::chrono::steady_clock::duration * dateTimeParse/* = nullptr*/)
+{
+  const std::string start_str = epgEntry.get("startTime", "").asString();
+  const std::string end_str = epgEntry.get("endTime", "").asString();
+  const auto parse_start = nullptr != dateTimeParse ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+  const time_t start_time = ParseDateTime(start_str);
+  const time_t end_time = ParseDateTime(end_str);
+  if (nullptr != dateTimeParse)
+    *dateTimeParse += std::chrono::steady_clock::now() - parse_start;
+  entry.iBroadcastId = start_time; // unique id for channel (even if time_t is wider, int should be enough for short period of time)
+  entry.iGenreType = 0;
+  entry.iGenreSubType = 0;
+  entry.iChannelId = channelUid;
+  entry.strTitle = epgEntry.get("title", "").asString();
+  entry.strPlot = epgEntry.get("description", "").asString();
+  entry.startTime = start_time;
+  entry.endTime = end_time;
+  entry.strEventId = epgEntry.get("eventId", "").asString();
+  entry.strIconPath = epgEntry.get("poster", "").asString();
+  std::string availability = epgEntry.get("availability", "none").asString();
+  entry.availableTimeshift = availability == "timeshift" || availability == "pvr";
+  entry.strRecordId = epgEntry["recordId"].asString();
+  entry.starRating = round(epgEntry.get("score", 0.0).asDouble());
+  const Json::Value parent_rating{epgEntry.get("ratingAge", Json::nullValue)};
+  entry.parentalRating = parent_rating.isNumeric() ? parent_rating.asInt() : 0;
+}
+
+size_t MergeEpg(const Json::Value & root, const channel_container_t & channels, epg_container_t & epg, const epg_change_sink_t & sink
+    , std::chrono::steady_clock::duration * dateTimeParse/* = nullptr*/)
+{
+  std::unordered_map<std::string, const Channel *> channels_index;
+  for (const auto & channel : channels)
+    channels_index.emplace(channel.strId, &channel);
+
+  size_t merged = 0;
+  const Json::Value & json_channels = root["channels"];
+  for (const auto & strChId : json_channels.getMemberNames())
+  {
+    const auto channel_i = channels_index.find(strChId);
+    if (channels_index.cend() == channel_i)
+      continue;
+
+    EpgChannel & epgChannel = epg[strChId];
+    epgChannel.strId = strChId;
+
+    const Json::Value & epgData = json_channels[strChId];
+    for (unsigned int j = 0; j < epgData.size(); j++)
+    {
+      const Json::Value & epgEntry = epgData[j];
+
+      EpgEntry iptventry;
+      ParseEpgEntry(epgEntry, channel_i->second->iUniqueId, iptventry, dateTimeParse);
+
+      LOG_TRACE("Loading TV show: %s - %s, start=%s(epoch=%llu)", strChId.c_str(), iptventry.strTitle.c_str()
+          , epgEntry.get("startTime", "").asString().c_str(), static_cast<long long unsigned>(iptventry.startTime));
+
+      // store it...and notify about the epg change
+      auto result = epgChannel.epg.emplace(iptventry.startTime, iptventry);
+      bool value_changed = !result.second;
+      if (value_changed)
+      {
+        result.first->second = std::move(iptventry);
+      }
+
+      sink(result.first->second, value_changed ? EC_UPDATED : EC_CREATED);
+      ++merged;
+    }
+  }
+  return merged;
+}
+
+std::shared_ptr<epg_container_t> ReleaseEpg(const epg_container_t & epg, time_t minTime, time_t maxTime, const epg_change_sink_t & sink)
+{
+  auto epg_copy = std::make_shared<epg_container_t>();
+
+  for (const auto & epg_channel : epg)
+  {
+    auto & epg_data = epg_channel.second.epg;
+    std::vector<time_t> to_delete;
+    for (auto entry_i = epg_data.cbegin(); entry_i != epg_data.cend(); ++entry_i)
+    {
+      const EpgEntry & entry = entry_i->second;
+      if (entry_i->second.startTime > maxTime || entry_i->second.endTime < minTime)
+      {
+        LOG_TRACE("Removing TV show: %s - %s, start=%s end=%s", epg_channel.second.strName.c_str(), entry.strTitle.c_str()
+            , ApiManager::formatTime(entry.startTime).c_str(), ApiManager::formatTime(entry.endTime).c_str());
+        // notify about the epg change...and delete it
+        sink(entry, EC_DELETED);
+
+        to_delete.push_back(entry_i->first);
+      }
+    }
+    if (!to_delete.empty())
+    {
+      auto & epg_copy_channel = (*epg_copy)[epg_channel.first];
+      epg_copy_channel = epg_channel.second;
+      for (const auto key_delete : to_delete)
+      {
+        epg_copy_channel.epg.erase(key_delete);
+      }
+    }
+  }
+
+  // check if something deleted, if so complete the copy
+  if (epg_copy->empty())
+    return nullptr;
+
+  for (const auto & epg_channel : epg)
+  {
+    if (epg_copy->count(epg_channel.first) <= 0)
+      (*epg_copy)[epg_channel.first] = epg_channel.second;
+  }
+  return epg_copy;
+}
+
+void ParseRecords(const Json::Value & root
+    , const channel_container_t & channels
+    , time_t now
+    , const std::string & lockedDirectory
+    , recording_container_t & recordings
+    , timer_container_t & timers
+    , long long & availableDuration
+    , long long & recordedDuration
+    )
+{
+  availableDuration = root["summary"].get("availableDuration", 0).asInt() / 60 * 1024; //report minutes as MB
+  recordedDuration = root["summary"].get("recordedDuration", 0).asInt() / 60 * 1024;
+
+  const Json::Value & records = root["records"];
+  for (unsigned int i = 0; i < records.size(); i++)
+  {
+    const Json::Value & record = records[i];
+    const std::string title = record.get("title", "").asString();
+    const std::string locked = record.get("channelLocked", "none").asString();
+    std::string directory;
+    if (locked != "none")
+    {
+      directory = lockedDirectory;
+      directory += " - ";
+      directory += locked;
+      Log(LL_INFO, "Timer/recording '%s' is locked(%s)", title.c_str(), locked.c_str());
+    }
+    std::string str_ch_id = record.get("channel", "").asString();
+    const auto channel_i = std::find_if(channels.cbegin(), channels.cend(), [&str_ch_id] (const Channel & ch) { return ch.strId == str_ch_id; });
+    Recording iptvrecording;
+    Timer iptvtimer;
+    time_t startTime = ParseDateTime(record.get("startTime", "").asString());
+    int duration = record.get("duration", 0).asInt();
+    if ((startTime + duration) < now)
+    {
+      char buf[256];
+      sprintf(buf, "%d", record.get("id", 0).asInt());
+      iptvrecording.strRecordId = buf;
+      iptvrecording.strTitle = std::move(title);
+
+      if (channel_i != channels.cend())
+      {
+        iptvrecording.strChannelName = channel_i->strChannelName;
+        iptvrecording.iChannelUid = channel_i->iUniqueId;
+        iptvrecording.bRadio = channel_i->bIsRadio;
+      } else
+      {
+        iptvrecording.iChannelUid = PVR_CHANNEL_INVALID_UID;
+        iptvrecording.bRadio = false;
+      }
+      iptvrecording.startTime = startTime;
+      iptvrecording.strPlotOutline = record.get("event", "").get("description", "").asString();
+      iptvrecording.duration = duration;
+      iptvrecording.iLifeTime = (ParseDateTime(record.get("expires", "").asString() + "00:00") - now) / 86400;
+      iptvrecording.strDirectory = std::move(directory);
+      iptvrecording.bIsPinLocked = locked == "pin";
+
+      LOG_TRACE("Loading recording '%s'", iptvrecording.strTitle.c_str());
+
+      recordings.push_back(std::move(iptvrecording));
+    }
+    else
+    {
+      iptvtimer.iClientIndex = record.get("id", 0).asInt();
+      iptvtimer.iClientChannelUid = channel_i != channels.cend() ? channel_i->iUniqueId : PVR_CHANNEL_INVALID_UID;
+      iptvtimer.startTime = ParseDateTime(record.get("startTime", "").asString());
+      iptvtimer.endTime = iptvtimer.startTime + record.get("duration", 0).asInt();
+
+      if (startTime < now && (startTime + duration) >= now)
+      {
+        iptvtimer.state = PVR_TIMER_STATE_RECORDING;
+      }
+      else
+      {
+        iptvtimer.state = PVR_TIMER_STATE_SCHEDULED;
+      }
+      iptvtimer.strTitle = std::move(title);
+      iptvtimer.iLifeTime = (ParseDateTime(record.get("expires", "").asString() + "00:00") - now) / 86400;
+      iptvtimer.strDirectory = std::move(directory);
+
+      LOG_TRACE("Loading timer '%s'", iptvtimer.strTitle.c_str());
+
+      timers.push_back(std::move(iptvtimer));
+    }
+
+  }
+}
+
+// rough per node overheads of the standard containers
+static constexpr size_t MAP_NODE_OVERHEAD = 4 * sizeof (void *); //!< color + parent/left/right
+static constexpr size_t HASH_NODE_OVERHEAD = 2 * sizeof (void *); //!< next + cached hash
+
+template <typename T>
+static size_t VectorHeapSize(const std::vector<T> & items)
+{
+  size_t size = items.capacity() * sizeof (T);
+  for (const auto & item : items)
+    size += HeapSize(item);
+  return size;
+}
+
+template <typename Map>
+static size_t HashHeapSize(const Map & map)
+{
+  return map.bucket_count() * sizeof (void *) + map.size() * (sizeof (typename Map::value_type) + HASH_NODE_OVERHEAD);
+}
+
+size_t HeapSize(const std::string & str)
+{
+  // the short strings are stored inside the object (SSO)
+  const char * data = str.data();
+  const char * object = reinterpret_cast<const char *>(&str);
+  return data >= object && data < object + sizeof (str) ? 0 : str.capacity() + 1;
+}
+
+static size_t HeapSize(const EpgEntry & entry)
+{
+  return HeapSize(entry.strTitle) + HeapSize(entry.strPlotOutline) + HeapSize(entry.strPlot) + HeapSize(entry.strIconPath)
+    + HeapSize(entry.strGenreString) + HeapSize(entry.strEventId) + HeapSize(entry.strRecordId);
+}
+
+size_t HeapSize(const EpgChannel & channel)
+{
+  size_t size = HeapSize(channel.strId) + HeapSize(channel.strName)
+    + channel.epg.size() * (sizeof (epg_entry_container_t::value_type) + MAP_NODE_OVERHEAD);
+  for (const auto & entry : channel.epg)
+    size += HeapSize(entry.second);
+  return size;
+}
+
+size_t HeapSize(const epg_container_t & epg)
+{
+  size_t size = epg.size() * (sizeof (epg_container_t::value_type) + MAP_NODE_OVERHEAD);
+  for (const auto & channel : epg)
+    size += HeapSize(channel.first) + HeapSize(channel.second);
+  return size;
+}
+
+static size_t HeapSize(const Channel & channel)
+{
+  return HeapSize(channel.strChannelName) + HeapSize(channel.strIconPath) + HeapSize(channel.strStreamURL)
+    + HeapSize(channel.strId) + HeapSize(channel.strGroupId) + HeapSize(channel.strStreamType);
+}
+
+size_t HeapSize(const channel_container_t & channels)
+{
+  return VectorHeapSize(channels);
+}
+
+size_t HeapSize(const channel_index_t & index)
+{
+  return HashHeapSize(index);
+}
+
+static size_t HeapSize(const ChannelGroup & group)
+{
+  return HeapSize(group.strGroupId) + HeapSize(group.strGroupName) + group.members.capacity() * sizeof (int);
+}
+
+size_t HeapSize(const group_container_t & groups)
+{
+  return VectorHeapSize(groups);
+}
+
+size_t HeapSize(const group_index_t & index)
+{
+  size_t size = HashHeapSize(index);
+  for (const auto & item : index)
+    size += HeapSize(item.first);
+  return size;
+}
+
+static size_t HeapSize(const Recording & recording)
+{
+  return HeapSize(recording.strRecordId) + HeapSize(recording.strTitle) + HeapSize(recording.strPlotOutline)
+    + HeapSize(recording.strPlot) + HeapSize(recording.strChannelName) + HeapSize(recording.strDirectory);
+}
+
+size_t HeapSize(const recording_container_t & recordings)
+{
+  return VectorHeapSize(recordings);
+}
+
+static size_t HeapSize(const Timer & timer)
+{
+  return HeapSize(timer.strTitle) + HeapSize(timer.strSummary) + HeapSize(timer.strDirectory);
+}
+
+size_t HeapSize(const timer_container_t & timers)
+{
+  return VectorHeapSize(timers);
+}
+
+size_t HeapSize(const stream_info_cache_t & cache)
+{
+  size_t size = cache.size() * (sizeof (stream_info_cache_t::value_type) + MAP_NODE_OVERHEAD);
+  for (const auto & item : cache)
+    size += HeapSize(item.first) + HeapSize(item.second.strStreamUrl) + HeapSize(item.second.strStreamType) + HeapSize(item.second.strChannelId);
+  return size;
+}
+
+size_t HeapSize(const channel_properties_t & properties)
+{
+  size_t size = HashHeapSize(properties);
+  for (const auto & channel : properties)
+  {
+    size += channel.second.capacity() * sizeof (StreamProperty);
+    for (const auto & property : channel.second)
+      size += HeapSize(property.name) + HeapSize(property.value);
+  }
+  return size;
+}
+
+} // namespace sledovanitvcz
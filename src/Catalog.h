@@ -0,0 +1,304 @@
+/*
+ *      Copyright (c) 2018~now Palo Kisa <palo.kisa@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this addon; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#ifndef sledovanitvcz_Catalog_h
+#define sledovanitvcz_Catalog_h
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <functional>
+#include <memory>
+#include <algorithm>
+#include <chrono>
+#include <type_traits>
+#include <ctime>
+#include "kodi/c-api/addon-instance/pvr/pvr_timers.h"
+
+/*!
+ * \file Catalog (channels, EPG, recordings, timers) data types and
+ * the parsing of backend responses into them. This is the core
+ * (Kodi independent) part of the addon.
+ */
+
+namespace Json
+{
+  class Value;
+}
+
+namespace sledovanitvcz
+{
+
+struct EpgEntry
+{
+  unsigned    iBroadcastId;
+  int         iChannelId;
+  int         iGenreType;
+  int         iGenreSubType;
+  time_t      startTime;
+  time_t      endTime;
+  std::string strTitle;
+  std::string strPlotOutline;
+  std::string strPlot;
+  std::string strIconPath;
+  std::string strGenreString;
+  std::string strEventId;
+  bool availableTimeshift;
+  std::string strRecordId; // optionally recorded
+  int starRating;
+  int parentalRating;
+};
+
+typedef std::map<time_t, EpgEntry> epg_entry_container_t;
+struct EpgChannel
+{
+  std::string                  strId;
+  std::string                  strName;
+  epg_entry_container_t epg;
+};
+
+struct Channel
+{
+  bool        bIsRadio;
+  int         iUniqueId;
+  int         iChannelNumber;
+  int         iEncryptionSystem;
+  int         iTvgShift;
+  std::string strChannelName;
+  std::string strIconPath;
+  std::string strStreamURL;
+  std::string strId;
+  std::string strGroupId;
+  std::string strStreamType;
+  bool        bIsPinLocked;
+  bool        bIsDrm;
+};
+
+struct ChannelGroup
+{
+  bool              bRadio;
+  std::string       strGroupId;
+  std::string       strGroupName;
+  std::vector<int>  members; //!< unique ids of member channels (in order)
+};
+
+struct Recording
+{
+  std::string		strRecordId;
+  std::string		strTitle;
+  std::string		strPlotOutline;
+  std::string		strPlot;
+  std::string		strChannelName;
+  time_t		startTime;
+  int			duration;
+  std::string strDirectory;
+  bool bRadio;
+  int iLifeTime;
+  int iChannelUid;
+  bool bIsPinLocked;
+};
+
+struct StreamInfo
+{
+  std::string strStreamUrl;
+  std::string strStreamType;
+  std::string strChannelId;
+  int         iDuration;
+  bool        bIsDrm;
+  time_t      expires;
+};
+
+struct Timer
+{
+  unsigned int    iClientIndex;
+  int             iClientChannelUid;
+  time_t          startTime;
+  time_t          endTime;
+  PVR_TIMER_STATE state;                                     /*!< @brief (required) the state of this timer */
+  std::string     strTitle;
+  std::string     strSummary;
+  int             iLifetime;
+  bool            bIsRepeating;
+  time_t          firstDay;
+  int             iWeekdays;
+  int             iEpgUid;
+  unsigned int    iMarginStart;
+  unsigned int    iMarginEnd;
+  int             iGenreType;
+  int             iGenreSubType;
+  int iLifeTime;
+  std::string strDirectory;
+};
+
+typedef std::vector<ChannelGroup> group_container_t;
+typedef std::unordered_map<std::string, size_t> group_index_t; //!< group name -> index in group_container_t
+typedef std::vector<Channel> channel_container_t;
+typedef std::unordered_map<int, size_t> channel_index_t; //!< channel unique id -> index in channel_container_t
+typedef std::map<std::string, EpgChannel> epg_container_t;
+typedef std::vector<Recording> recording_container_t;
+typedef std::unordered_map<std::string, size_t> recording_index_t; //!< recording id -> index in recording_container_t
+typedef std::vector<Timer> timer_container_t;
+typedef std::map<std::string, std::string> properties_t;
+typedef std::map<std::string, StreamInfo> stream_info_cache_t;
+
+//! Stream property for the player (inputstream), the name is one of PVR_STREAM_PROPERTY_*
+struct StreamProperty
+{
+  std::string name;
+  std::string value;
+};
+typedef std::vector<StreamProperty> stream_properties_t;
+typedef std::unordered_map<int, stream_properties_t> channel_properties_t; //!< channel unique id -> live stream properties
+
+template <typename Key>
+struct ContainerDiff
+{
+  std::set<Key> added;
+  std::set<Key> removed;
+  std::set<Key> modified;
+
+  bool empty() const
+  {
+    return added.empty() && removed.empty() && modified.empty();
+  }
+};
+
+bool operator ==(const Recording & a, const Recording & b);
+bool operator ==(const Timer & a, const Timer & b);
+
+/*!
+ * \brief Compare the containers by id (obtained by \param keyGetter), the order
+ * of the elements doesn't matter.
+ */
+template <typename Container, typename KeyGetter>
+auto DiffById(const Container & oldItems, const Container & newItems, KeyGetter keyGetter)
+  -> ContainerDiff<typename std::decay<decltype (keyGetter(oldItems.front()))>::type>
+{
+  typedef typename std::decay<decltype (keyGetter(oldItems.front()))>::type key_t;
+  ContainerDiff<key_t> diff;
+  std::map<key_t, const typename Container::value_type *> old_index;
+  for (const auto & item : oldItems)
+    old_index.emplace(keyGetter(item), &item);
+
+  for (const auto & item : newItems)
+  {
+    auto key = keyGetter(item);
+    auto old_i = old_index.find(key);
+    if (old_index.end() == old_i)
+    {
+      diff.added.insert(std::move(key));
+    } else
+    {
+      if (!(*old_i->second == item))
+        diff.modified.insert(std::move(key));
+      old_index.erase(old_i);
+    }
+  }
+  for (const auto & old_item : old_index)
+    diff.removed.insert(old_item.first);
+  return diff;
+}
+
+/*!
+ * \brief Store the stream info into the cache, evicting the expired/oldest entries if it is full
+ */
+void CacheStreamInfo(stream_info_cache_t & cache, const std::string & key, const StreamInfo & info, size_t maxSize, time_t now);
+
+unsigned DiffBetweenUtcAndLocalTime(const time_t * when = nullptr, int * isdst = nullptr);
+//! Parse the backend (Prague local) time "YYYY-MM-DD HH:MM"
+time_t ParseDateTime(const std::string & strDate);
+bool ParseJson(const std::string & content, Json::Value & root);
+
+/*!
+ * \brief Parse the channels & groups from the playlist response
+ * \param uniqueId provider of the channel unique id (by the channel id)
+ */
+void ParsePlayList(const Json::Value & root
+    , bool showLockedChannels
+    , bool showLockedOnlyPin
+    , const std::function<int (const std::string & channelId)> & uniqueId
+    , channel_container_t & channels
+    , group_container_t & groups
+    , group_index_t & groupsIndex
+    );
+/*!
+ * \brief Parse one entry of the (channel's) epg response
+ * \param dateTimeParse if not null, the time of the date/time parsing is added into it
+ */
+void ParseEpgEntry(const Json::Value & epgEntry, int channelUid, EpgEntry & entry, std::chrono::steady_clock::duration * dateTimeParse = nullptr);
+
+enum EpgChange_t
+{
+  EC_CREATED
+    , EC_UPDATED
+    , EC_DELETED
+};
+//! Receiver of the EPG entries changes (e.g. the Kodi notification)
+typedef std::function<void (const EpgEntry & entry, EpgChange_t change)> epg_change_sink_t;
+
+/*!
+ * \brief Merge the entries of the epg response into \param epg (entries of unknown channels are skipped)
+ * \param dateTimeParse if not null, the time of the entries date/time parsing is added into it
+ * \return count of merged entries
+ */
+size_t MergeEpg(const Json::Value & root, const channel_container_t & channels, epg_container_t & epg, const epg_change_sink_t & sink
+    , std::chrono::steady_clock::duration * dateTimeParse = nullptr);
+/*!
+ * \brief Release the entries outside of the <\param minTime, \param maxTime> window
+ * \return the new epg or nullptr if nothing was released
+ */
+std::shared_ptr<epg_container_t> ReleaseEpg(const epg_container_t & epg, time_t minTime, time_t maxTime, const epg_change_sink_t & sink);
+/*!
+ * \brief Parse the records from the get-pvr response, the finished ones are recordings, others timers
+ * \param lockedDirectory the directory (prefix) for records on locked channels
+ */
+void ParseRecords(const Json::Value & root
+    , const channel_container_t & channels
+    , time_t now
+    , const std::string & lockedDirectory
+    , recording_container_t & recordings
+    , timer_container_t & timers
+    , long long & availableDuration
+    , long long & recordedDuration
+    );
+
+/*!
+ * \name Approximate heap footprint of the catalog data: the allocations owned
+ * by the container (elements, nodes, buckets, strings), not the object itself
+ */
+//! @{
+size_t HeapSize(const std::string & str);
+size_t HeapSize(const EpgChannel & channel);
+size_t HeapSize(const epg_container_t & epg);
+size_t HeapSize(const channel_container_t & channels);
+size_t HeapSize(const channel_index_t & index);
+size_t HeapSize(const group_container_t & groups);
+//! \note also for recording_index_t (the same type)
+size_t HeapSize(const group_index_t & index);
+size_t HeapSize(const recording_container_t & recordings);
+size_t HeapSize(const timer_container_t & timers);
+size_t HeapSize(const stream_info_cache_t & cache);
+size_t HeapSize(const channel_properties_t & properties);
+//! @}
+
+} // namespace sledovanitvcz
+#endif // sledovanitvcz_Catalog_h
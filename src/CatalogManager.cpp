@@ -0,0 +1,1530 @@
+/*
+ *      Copyright (c) 2018~now Palo Kisa <palo.kisa@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this addon; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include "CatalogManager.h"
+#include "Trace.h"
+#include "CallLimiter.hh"
+#include "base64.hpp"
+#include "kodi/c-api/addon-instance/pvr/pvr_general.h"
+#include <json/json.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <limits>
+#include <sstream>
+
+namespace sledovanitvcz
+{
+
+static const std::string CHANNEL_UIDS_FILE = "channeluids";
+static const std::string STORED_EPG_FILE = "stored-epg";
+static const std::string API_STATS_FILE = "api-stats";
+static const std::string CATALOG_STATS_FILE = "catalog-stats";
+static const std::string STARTUP_STATS_FILE = "startup-stats";
+static constexpr size_t STARTUP_STATS_MAX = 20; //!< count of the startups kept in the startup stats file
+static constexpr unsigned LOGIN_RETRY_MIN = 30; //!< delay (seconds) of the first login retry
+static constexpr unsigned LOGIN_RETRY_MAX = 15 * 60; //!< max delay (seconds) between login retries
+static constexpr time_t RECORDING_STREAM_TTL = 15 * 60; //!< validity of cached recording stream info
+static constexpr size_t RECORDING_STREAMS_MAX = 64; //!< max count of cached recording stream infos
+static constexpr size_t RECORDING_PREFETCH_MAX = 5; //!< max count of new recordings stream info prefetched
+static constexpr time_t TIMESHIFT_STREAM_TTL = 15 * 60; //!< validity of cached EPG event (timeshift) stream info
+static constexpr size_t TIMESHIFT_STREAMS_MAX = 64; //!< max count of cached EPG event (timeshift) stream infos
+static constexpr size_t RECENT_CHANNELS_MAX = 3; //!< count of recently watched channels with pre-resolved timeshift
+static constexpr time_t TIMESHIFT_PREFETCH_RETRY = 60; //!< delay of the timeshift pre-resolution retry on failure
+
+CatalogManager::CatalogManager(std::shared_ptr<ApiManager> manager
+    , std::shared_ptr<FileSystem> fileSystem
+    , uint64_t instanceNo
+    , const Settings & settings
+    , CatalogSink & sink
+    )
+  : m_bKeepAlive{true}
+  , m_bLoadRecordings{true}
+  , m_bLoadPlayList{true}
+  , m_bRegisterDrm{false}
+  , m_bChannelsLoaded{false}
+  , m_catalog{
+    std::make_shared<group_container_t>()
+    , std::make_shared<group_index_t>()
+    , std::make_shared<channel_container_t>()
+    , std::make_shared<channel_index_t>()
+    , std::make_shared<channel_properties_t>()
+    , std::make_shared<epg_container_t>()
+    , std::make_shared<recording_container_t>()
+    , std::make_shared<recording_index_t>()
+    , std::make_shared<timer_container_t>()
+  }
+  , m_recordingAvailableDuration{0}
+  , m_recordingRecordedDuration{0}
+  , m_epgMinTime{time(nullptr)}
+  , m_epgMaxTime{time(nullptr) + 3600}
+  , m_epgMaxFutureDays{settings.epgMaxFutureDays}
+  , m_epgMaxPastDays{settings.epgMaxPastDays}
+  , m_nextTimerTransition{0}
+  , m_nextTimeShiftPrefetch{0}
+  , m_loadRecordingsAt{0}
+  , m_catalogTime{0}
+  , m_bOffline{false}
+  , m_epgLoadedStart{0}
+  , m_epgLoadedEnd{0}
+  , m_playlistFingerprint{0}
+  , m_pvrFingerprint{0}
+  , m_bLogin{true}
+  , m_nextLoginAttempt{0}
+  , m_loginRetryDelay{LOGIN_RETRY_MIN}
+  , m_bEGPLoaded{false}
+  , m_iLastStart{0}
+  , m_iLastEnd{0}
+  , m_settings(settings)
+  , m_manager{std::move(manager)}
+  , m_fileSystem{std::move(fileSystem)}
+  , m_instanceNo{instanceNo}
+  , m_sink(sink)
+{
+  SetEPGMaxDays(m_epgMaxFutureDays, m_epgMaxPastDays);
+}
+
+CatalogManager::~CatalogManager()
+{
+  Stop();
+}
+
+void CatalogManager::Start()
+{
+  LoadChannelUids();
+
+  // publish the last known data right away (the backend is asked in background)
+  Json::Value stored_root;
+  time_t stored_time = 0;
+  if (m_manager->getStoredPlaylist(stored_root, m_playlistFingerprint, stored_time))
+  {
+    ApplyPlayList(stored_root, true);
+    {
+      std::lock_guard<std::mutex> critical(m_mutex);
+      m_catalogTime = stored_time;
+    }
+    LoadStoredEPG();
+    stored_root.clear();
+    if (m_manager->getStoredPvr(stored_root, m_pvrFingerprint, stored_time))
+      ApplyRecordings(stored_root, true);
+  }
+
+  m_thread = std::thread{[this] { Process(); }};
+}
+
+void CatalogManager::Stop()
+{
+  {
+    std::lock_guard<std::mutex> critical(m_mutex);
+    m_bKeepAlive = false;
+  }
+  if (!m_thread.joinable())
+    return;
+  m_thread.join();
+  StoreEPG();
+  // report also the unfinished startup (e.g. backend unreachable), no-op if already reported
+  ReportStartup();
+  if (0 < m_settings.statsInterval)
+    DumpStats();
+}
+
+template<typename Job>
+bool CatalogManager::SimpleLoadJob(bool & jobGuard, const Job & job)
+{
+  if (!KeepAlive())
+    return false;
+
+  bool load = false;
+  {
+    std::lock_guard<std::mutex> critical(m_mutex);
+    if (jobGuard)
+    {
+      load = true;
+      jobGuard = false;
+    }
+  }
+  if (load)
+  {
+    job();
+  }
+  return load;
+}
+
+void CatalogManager::SetLoadRecordings()
+{
+  std::lock_guard<std::mutex> critical(m_mutex);
+  m_bLoadRecordings = true;
+}
+
+void CatalogManager::SetLoadRecordingsDeferred()
+{
+  // Note: every new request postpones the load, so a series of user actions
+  // results in just one reload
+  static constexpr time_t RECONCILE_DELAY = 30;
+  std::lock_guard<std::mutex> critical(m_mutex);
+  m_loadRecordingsAt = time(nullptr) + RECONCILE_DELAY;
+}
+
+bool CatalogManager::DeferredLoadRecordingsJob()
+{
+  std::lock_guard<std::mutex> critical(m_mutex);
+  if (0 == m_loadRecordingsAt || time(nullptr) < m_loadRecordingsAt)
+    return false;
+  m_loadRecordingsAt = 0;
+  m_bLoadRecordings = true;
+  // our local changes must be reconciled with the backend state
+  m_pvrFingerprint = 0;
+  return true;
+}
+
+void CatalogManager::SetLoadPlaylist()
+{
+  std::lock_guard<std::mutex> critical(m_mutex);
+  m_bLoadPlayList = true;
+  m_bChannelsLoaded = false;
+}
+
+void CatalogManager::TriggerFullRefresh()
+{
+  Log(LL_INFO, "%s triggering channels/EGP full refresh", __FUNCTION__);
+  m_iLastEnd = 0;
+  m_iLastStart = 0;
+
+  int future_days = 0, past_days = 0;
+  {
+    std::lock_guard<std::mutex> critical(m_mutex);
+    future_days = m_epgMaxFutureDays;
+    past_days = m_epgMaxPastDays;
+  }
+  SetEPGMaxDays(future_days, past_days);
+  LoadPlayList();
+}
+
+bool CatalogManager::LoadEPGJob()
+{
+  LOG_DEBUG("%s will check if EGP loading needed", __FUNCTION__);
+  time_t min_epg, max_epg;
+  {
+    std::lock_guard<std::mutex> critical(m_mutex);
+    min_epg = m_epgMinTime;
+    max_epg = m_epgMaxTime;
+  }
+  bool updated = false;
+  if (KeepAlive() && 0 == m_iLastEnd)
+  {
+    // the first run...load just needed data as soon as posible
+    LoadEPG(time(nullptr), true);
+    updated = true;
+  } else
+  {
+    if (KeepAlive() && max_epg > m_iLastEnd)
+    {
+      time_t start = m_iLastEnd + DiffBetweenUtcAndLocalTime(&m_iLastEnd);
+      LoadEPG(start - (start % 86400) - DiffBetweenUtcAndLocalTime(&start), false);
+      updated = true;
+    }
+    if (KeepAlive() && min_epg < m_iLastStart)
+    {
+      time_t start = m_iLastStart - 86400;
+      start += DiffBetweenUtcAndLocalTime(&start);
+      LoadEPG(start - (start % 86400) - DiffBetweenUtcAndLocalTime(&start), false);
+      updated = true;
+    }
+  }
+  if (KeepAlive())
+    ReleaseUnneededEPG();
+  return updated;
+}
+
+void CatalogManager::ReleaseUnneededEPG()
+{
+  TraceSpan span{"ReleaseUnneededEPG"};
+  decltype (m_catalog.epg) epg;
+  time_t min_epg, max_epg;
+  {
+    std::lock_guard<std::mutex> critical(m_mutex);
+    min_epg = m_epgMinTime;
+    max_epg = m_epgMaxTime;
+    epg = m_catalog.epg;
+  }
+  LOG_DEBUG("%s min_epg=%s max_epg=%s", __FUNCTION__, ApiManager::formatTime(min_epg).c_str(), ApiManager::formatTime(max_epg).c_str());
+
+  auto epg_copy = ReleaseEpg(*epg, min_epg, max_epg, std::bind(&CatalogSink::EpgChanged, &m_sink, std::placeholders::_1, std::placeholders::_2));
+  if (epg_copy)
+  {
+    {
+      std::lock_guard<std::mutex> critical(m_mutex);
+      m_catalog.epg = std::move(epg_copy);
+    }
+    // some data were released, the EPG windows need to be really reloaded next time
+    m_epgFingerprints.clear();
+  }
+
+  // narrow the loaded time info (if needed)
+  m_iLastStart = std::max(m_iLastStart, min_epg);
+  m_iLastEnd = std::min(m_iLastEnd, max_epg);
+  {
+    std::lock_guard<std::mutex> critical(m_mutex);
+    if (0 != m_epgLoadedStart)
+    {
+      m_epgLoadedStart = m_iLastStart;
+      m_epgLoadedEnd = m_iLastEnd;
+    }
+  }
+}
+
+void CatalogManager::KeepAliveJob()
+{
+  if (!KeepAlive())
+    return;
+
+  TraceSpan span{"KeepAliveJob"};
+  LOG_DEBUG("keepAlive:: trigger");
+  if (!m_manager->keepAlive())
+  {
+    // the session is lost, the next login attempt right away
+    m_bLogin = true;
+    m_nextLoginAttempt = 0;
+  }
+}
+
+bool CatalogManager::LoginJob()
+{
+  const time_t now = time(nullptr);
+  if (!m_bLogin || now < m_nextLoginAttempt)
+    return false;
+
+  TraceSpan span{"LoginJob"};
+  if (m_manager->login())
+  {
+    m_bLogin = false;
+    m_loginRetryDelay = LOGIN_RETRY_MIN;
+    // DRM registration is not needed for non-DRM channels -> do it in background
+    {
+      std::lock_guard<std::mutex> critical(m_mutex);
+      m_bRegisterDrm = true;
+      m_bOffline = false;
+      // resolved stream URLs could be bound to the previous session
+      m_recordingStreams.clear();
+      m_timeShiftStreams.clear();
+    }
+    m_sink.ConnectionChanged(CS_CONNECTED);
+    StartupMilestone(&StartupMetrics::connected);
+    return true;
+  }
+
+  bool was_offline = false;
+  time_t catalog_time = 0;
+  {
+    std::lock_guard<std::mutex> critical(m_mutex);
+    was_offline = m_bOffline;
+    catalog_time = m_catalogTime;
+    m_bOffline = 0 != catalog_time;
+  }
+  if (0 != catalog_time)
+  {
+    // degraded mode -> keep the (read-only) stored data available
+    if (!was_offline)
+    {
+      Log(LL_WARNING, "Login failed, serving stored data from %s", ApiManager::formatTime(catalog_time).c_str());
+      m_sink.ConnectionChanged(CS_OFFLINE);
+    }
+  } else
+  {
+    m_sink.ConnectionChanged(CS_DISCONNECTED);
+  }
+  LOG_DEBUG("%s next login attempt in %u s", __FUNCTION__, m_loginRetryDelay);
+  m_nextLoginAttempt = now + m_loginRetryDelay;
+  m_loginRetryDelay = std::min(m_loginRetryDelay * 2, LOGIN_RETRY_MAX);
+  return true;
+}
+
+CatalogSnapshot CatalogManager::Snapshot() const
+{
+  std::lock_guard<std::mutex> critical(m_mutex);
+  return m_catalog;
+}
+
+void CatalogManager::DriveSpace(long long & available, long long & recorded) const
+{
+  std::lock_guard<std::mutex> critical(m_mutex);
+  available = m_recordingAvailableDuration;
+  recorded = m_recordingRecordedDuration;
+}
+
+bool CatalogManager::Offline() const
+{
+  std::lock_guard<std::mutex> critical(m_mutex);
+  return m_bOffline;
+}
+
+time_t CatalogManager::CatalogAge() const
+{
+  std::lock_guard<std::mutex> critical(m_mutex);
+  return 0 == m_catalogTime ? 0 : time(nullptr) - m_catalogTime;
+}
+
+bool CatalogManager::EpgCoverage(time_t & start, time_t & end) const
+{
+  std::lock_guard<std::mutex> critical(m_mutex);
+  start = m_epgLoadedStart;
+  end = m_epgLoadedEnd;
+  return 0 != start;
+}
+
+bool CatalogManager::LoggedIn() const
+{
+  return m_manager->loggedIn();
+}
+
+const ApiManager & CatalogManager::Api() const
+{
+  return *m_manager;
+}
+
+void CatalogManager::RegisterDrm()
+{
+  std::string licenseUrl, certificate;
+  if (!m_manager->registerDrm(licenseUrl, certificate))
+  {
+    Log(LL_WARNING, "DRM registration failed. DRM may not work");
+  }
+  static constexpr char url_placeholder[] = "={streamURL|base64}";
+  auto pos = licenseUrl.rfind(url_placeholder);
+  if (pos == licenseUrl.size() - sizeof(url_placeholder) + 1)
+    licenseUrl.erase(pos + 1);
+  else
+      Log(LL_WARNING, "Expecting DRM licenseUrl in form '...&streamURL%s', got %s. DRM may not work", url_placeholder, licenseUrl.c_str());
+  certificate = base64::to_base64(certificate);
+  {
+    std::lock_guard<std::mutex> critical(m_mutex);
+    m_drmCertificate = std::make_shared<std::string>(std::move(certificate));
+    m_drmLicenseUrl = std::make_shared<std::string>(std::move(licenseUrl));
+  }
+  m_waitCond.notify_all();
+  UpdateChannelsProperties();
+}
+
+bool CatalogManager::WaitForChannels() const
+{
+  std::unique_lock<std::mutex> critical(m_mutex);
+  if (m_bChannelsLoaded)
+    return true;
+  const auto start = std::chrono::steady_clock::now();
+  const bool loaded = m_waitCond.wait_for(critical, std::chrono::seconds{5}, [this] { return m_bChannelsLoaded; });
+  if (!m_startup.reported)
+  {
+    m_startup.waitBlocked += std::chrono::steady_clock::now() - start;
+    ++m_startup.waits;
+  }
+  return loaded;
+}
+
+void CatalogManager::StartupMilestone(std::chrono::steady_clock::duration StartupMetrics::* milestone)
+{
+  {
+    std::lock_guard<std::mutex> critical(m_mutex);
+    auto & value = m_startup.*milestone;
+    if (0 <= value.count())
+      return;
+    value = std::chrono::steady_clock::now() - m_startup.created;
+    if (m_startup.reported || 0 > m_startup.connected.count() || 0 > m_startup.channels.count() || 0 > m_startup.epg.count())
+      return;
+  }
+  ReportStartup();
+}
+
+void CatalogManager::ReportStartup()
+{
+  StartupMetrics startup;
+  {
+    std::lock_guard<std::mutex> critical(m_mutex);
+    if (m_startup.reported)
+      return;
+    m_startup.reported = true;
+    startup = m_startup;
+  }
+  auto format_ms = [] (std::chrono::steady_clock::duration d) {
+    return 0 > d.count() ? std::string{"-"}
+      : std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(d).count());
+  };
+  const std::string summary = "connected_ms=" + format_ms(startup.connected)
+    + " channels_ms=" + format_ms(startup.channels) + (startup.storedChannels ? "(stored)" : "")
+    + " epg_ms=" + format_ms(startup.epg)
+    + " wait_ms=" + format_ms(startup.waitBlocked) + " waits=" + std::to_string(startup.waits);
+  Log(LL_INFO, "Startup: %s", summary.c_str());
+
+  // keep just the last startups
+  const std::string path = InstanceFilePath(STARTUP_STATS_FILE);
+  std::string content;
+  m_fileSystem->ReadFile(path, content);
+  std::deque<std::string> lines;
+  std::istringstream input{content};
+  for (std::string line; std::getline(input, line); )
+  {
+    if (!line.empty())
+      lines.push_back(std::move(line));
+  }
+  lines.push_back(ApiManager::formatTime(time(nullptr)) + '\t' + summary);
+  while (lines.size() > STARTUP_STATS_MAX)
+    lines.pop_front();
+  content.clear();
+  for (const auto & line : lines)
+    content += line + '\n';
+  m_fileSystem->WriteFile(path, content);
+}
+
+void CatalogManager::Process()
+{
+  LOG_DEBUG("keepAlive:: thread started");
+
+  bool epg_updated = false;
+
+  auto keep_alive_job = getCallLimiter(std::bind(&CatalogManager::KeepAliveJob, this), std::chrono::seconds{m_settings.keepAliveDelay}, true);
+  auto trigger_full_refresh = getCallLimiter(std::bind(&CatalogManager::TriggerFullRefresh, this), std::chrono::seconds{m_settings.fullChannelEpgRefresh}, true);
+  auto trigger_load_recordings = getCallLimiter(std::bind(&CatalogManager::SetLoadRecordings, this), std::chrono::seconds{m_settings.loadingsRefresh}, true);
+  auto epg_dummy_trigger = getCallLimiter([] {}, std::chrono::seconds{m_settings.epgCheckDelay}, false); // using the CallLimiter just to test if the epg should be done
+  auto store_epg_job = getCallLimiter(std::bind(&CatalogManager::StoreEPG, this), std::chrono::hours{1}, true);
+  auto dump_stats_job = getCallLimiter(std::bind(&CatalogManager::DumpStats, this), std::chrono::seconds{std::max(m_settings.statsInterval, 1u)}, true);
+  auto flush_trace_job = getCallLimiter(&FlushTrace, std::chrono::seconds{10}, true);
+  auto load_playlist_job = std::bind(&CatalogManager::LoadPlayList, this);
+  auto load_recordings_job = std::bind(&CatalogManager::LoadRecordings, this);
+  auto register_drm_job = std::bind(&CatalogManager::RegisterDrm, this);
+
+  bool work_done = true;
+  while (KeepAlive())
+  {
+    if (!work_done)
+      std::this_thread::sleep_for(std::chrono::seconds{1});
+
+    TraceSpan span{"Process"};
+    work_done = false;
+
+    // (re)login when scheduled, the backend jobs wait for it, the local ones keep running
+    work_done |= LoginJob();
+    if (!m_bLogin)
+    {
+      work_done |= SimpleLoadJob(m_bLoadPlayList, load_playlist_job);
+      work_done |= SimpleLoadJob(m_bLoadRecordings, load_recordings_job);
+      work_done |= SimpleLoadJob(m_bRegisterDrm, register_drm_job);
+      // trigger full refresh once a time
+      work_done |= trigger_full_refresh.Call();
+      // pre-resolve "play from start" of recently watched channels
+      work_done |= TimeShiftPrefetchJob();
+
+      if (epg_dummy_trigger.Call() || epg_updated)
+      {
+        // perform epg loading in next cycle if something updated in this one
+        epg_updated = LoadEPGJob();
+        work_done = true;
+      } else
+      {
+        epg_updated = false;
+      }
+
+      // do keep alive call once a time
+      work_done |= keep_alive_job.Call();
+    }
+    // trigger loading of recordings once a time (just for safety, changes are expected on timers transitions)
+    work_done |= trigger_load_recordings.Call();
+    // update timers/recordings if some timer started/ended
+    work_done |= TimersTransitionJob();
+    // reconcile recordings after user actions
+    work_done |= DeferredLoadRecordingsJob();
+    // store the EPG (for the next start/offline mode) once a time
+    work_done |= store_epg_job.Call();
+    if (0 < m_settings.statsInterval)
+      dump_stats_job.Call();
+    if (!work_done)
+      span.Discard();
+    if (TraceEnabled())
+      flush_trace_job.Call();
+  }
+  LOG_DEBUG("keepAlive:: thread stopped");
+}
+
+bool CatalogManager::KeepAlive() const
+{
+  std::lock_guard<std::mutex> critical(m_mutex);
+  return m_bKeepAlive;
+}
+
+void CatalogManager::StoreEPG()
+{
+  decltype (m_catalog.epg) epg;
+  {
+    std::lock_guard<std::mutex> critical(m_mutex);
+    epg = m_catalog.epg;
+  }
+  if (epg == m_storedEpg)
+    return;
+
+  TraceSpan span{"StoreEPG"};
+  Json::Value root{Json::objectValue};
+  Json::Value & json_channels = root["channels"];
+  for (const auto & epg_channel : *epg)
+  {
+    Json::Value & json_entries = json_channels[epg_channel.first];
+    json_entries = Json::Value{Json::arrayValue};
+    for (const auto & entry_pair : epg_channel.second.epg)
+    {
+      const EpgEntry & entry = entry_pair.second;
+      Json::Value json_entry;
+      json_entry["broadcastId"] = entry.iBroadcastId;
+      json_entry["channelId"] = entry.iChannelId;
+      json_entry["startTime"] = static_cast<Json::Int64>(entry.startTime);
+      json_entry["endTime"] = static_cast<Json::Int64>(entry.endTime);
+      json_entry["title"] = entry.strTitle;
+      json_entry["plot"] = entry.strPlot;
+      json_entry["icon"] = entry.strIconPath;
+      json_entry["eventId"] = entry.strEventId;
+      json_entry["timeshift"] = entry.availableTimeshift;
+      json_entry["recordId"] = entry.strRecordId;
+      json_entry["starRating"] = entry.starRating;
+      json_entry["parentalRating"] = entry.parentalRating;
+      json_entries.append(std::move(json_entry));
+    }
+  }
+
+  Json::StreamWriterBuilder writer_builder;
+  writer_builder["indentation"] = "";
+  if (m_fileSystem->WriteFile(InstanceFilePath(STORED_EPG_FILE), Json::writeString(writer_builder, root)))
+    m_storedEpg = std::move(epg);
+}
+
+void CatalogManager::LoadStoredEPG()
+{
+  std::string content;
+  Json::Value root;
+  if (!m_fileSystem->ReadFile(InstanceFilePath(STORED_EPG_FILE), content) || !ParseJson(content, root) || !root.isObject())
+    return;
+
+  auto epg = std::make_shared<epg_container_t>();
+  const Json::Value & json_channels = root["channels"];
+  for (const auto & channel_id : json_channels.getMemberNames())
+  {
+    EpgChannel & epg_channel = (*epg)[channel_id];
+    epg_channel.strId = channel_id;
+    for (const auto & json_entry : json_channels[channel_id])
+    {
+      EpgEntry entry;
+      entry.iBroadcastId = json_entry["broadcastId"].asUInt();
+      entry.iChannelId = json_entry["channelId"].asInt();
+      entry.iGenreType = 0;
+      entry.iGenreSubType = 0;
+      entry.startTime = json_entry["startTime"].asInt64();
+      entry.endTime = json_entry["endTime"].asInt64();
+      entry.strTitle = json_entry["title"].asString();
+      entry.strPlot = json_entry["plot"].asString();
+      entry.strIconPath = json_entry["icon"].asString();
+      entry.strEventId = json_entry["eventId"].asString();
+      entry.availableTimeshift = json_entry["timeshift"].asBool();
+      entry.strRecordId = json_entry["recordId"].asString();
+      entry.starRating = json_entry["starRating"].asInt();
+      entry.parentalRating = json_entry["parentalRating"].asInt();
+      epg_channel.epg.emplace(entry.startTime, std::move(entry));
+    }
+  }
+  LOG_DEBUG("%s loaded stored EPG for %u channels", __FUNCTION__, static_cast<unsigned>(epg->size()));
+
+  std::lock_guard<std::mutex> critical(m_mutex);
+  m_catalog.epg = epg;
+  m_storedEpg = std::move(epg);
+}
+
+bool CatalogManager::LoadEPG(time_t iStart, bool bSmallStep)
+{
+  const int step = bSmallStep ? 3600 : 86400;
+  LOG_DEBUG("%s last start %s, start %s, last end %s, end %s", __FUNCTION__, ApiManager::formatTime(m_iLastStart).c_str()
+      , ApiManager::formatTime(iStart).c_str(), ApiManager::formatTime(m_iLastEnd).c_str(), ApiManager::formatTime(iStart + step).c_str());
+  if (m_bEGPLoaded && m_iLastStart != 0 && iStart >= m_iLastStart && iStart + step <= m_iLastEnd)
+    return false;
+
+  TraceSpan span{"LoadEPG"};
+
+  Json::Value root;
+
+  ApiManager::Fingerprint_t & fingerprint = m_epgFingerprints[std::make_pair(iStart, bSmallStep)];
+  const ApiManager::Fingerprint_t last_fingerprint = fingerprint;
+  if (!m_manager->getEpg(iStart, bSmallStep, std::string(), root, fingerprint))
+  {
+    Log(LL_INFO, "Cannot parse EPG data. EPG not loaded.");
+    m_bEGPLoaded = true;
+    return false;
+  }
+  const bool unchanged = last_fingerprint == fingerprint;
+
+  if (m_iLastEnd == 0)
+  {
+    // the first run
+    m_iLastStart = m_iLastEnd = iStart;
+  } else
+  {
+    if (m_iLastStart > iStart)
+      m_iLastStart = iStart;
+    if (iStart + step > m_iLastEnd)
+      m_iLastEnd = iStart + step;
+  }
+
+  decltype (m_catalog.channels) channels;
+  decltype (m_catalog.epg) epg;
+  {
+    std::lock_guard<std::mutex> critical(m_mutex);
+    channels = m_catalog.channels;
+    epg = m_catalog.epg;
+    // extend min/max (if needed)
+    m_epgMinTime = std::min(m_epgMinTime, m_iLastStart);
+    m_epgMaxTime = std::max(m_epgMaxTime, m_iLastEnd);
+    m_epgLoadedStart = m_iLastStart;
+    m_epgLoadedEnd = m_iLastEnd;
+  }
+
+  if (unchanged)
+  {
+    LOG_DEBUG("%s EPG data unchanged since the last load", __FUNCTION__);
+    m_bEGPLoaded = true;
+    return true;
+  }
+
+  std::shared_ptr<epg_container_t> epg_copy;
+  {
+    TraceSpan copy_span{"LoadEPG copy"};
+    epg_copy = std::make_shared<epg_container_t>(*epg);
+  }
+
+  {
+    TraceSpan merge_span{"MergeEpg"};
+    if (TraceEnabled())
+    {
+      // the time of the date/time parsing and of the sink notifications (parts of the merge) is measured just when tracing
+      std::chrono::steady_clock::duration parse_time{0};
+      std::chrono::steady_clock::duration notify_time{0};
+      MergeEpg(root, *channels, *epg_copy, [this, &notify_time] (const EpgEntry & entry, EpgChange_t change) {
+          const auto start = std::chrono::steady_clock::now();
+          m_sink.EpgChanged(entry, change);
+          notify_time += std::chrono::steady_clock::now() - start;
+        }, &parse_time);
+      merge_span.SetArg("ParseDateTime_us", std::chrono::duration_cast<std::chrono::microseconds>(parse_time).count());
+      merge_span.SetArg("EpgEventStateChange_us", std::chrono::duration_cast<std::chrono::microseconds>(notify_time).count());
+    } else
+    {
+      MergeEpg(root, *channels, *epg_copy, std::bind(&CatalogSink::EpgChanged, &m_sink, std::placeholders::_1, std::placeholders::_2));
+    }
+  }
+
+  // atomic assign new version of the epg all epgs
+  {
+    std::lock_guard<std::mutex> critical(m_mutex);
+    m_catalog.epg = epg_copy;
+    // the currently airing programmes could be changed
+    m_nextTimeShiftPrefetch = 0;
+  }
+  StartupMilestone(&StartupMetrics::epg);
+
+  m_bEGPLoaded = true;
+  Log(LL_INFO, "EPG Loaded.");
+
+  return true;
+}
+
+bool CatalogManager::LoadRecordings()
+{
+  TraceSpan span{"LoadRecordings"};
+  Json::Value root;
+
+  const ApiManager::Fingerprint_t last_fingerprint = m_pvrFingerprint;
+  if (!m_manager->getPvr(root, m_pvrFingerprint))
+  {
+    Log(LL_INFO, "Cannot parse recordings.");
+    return false;
+  }
+  if (last_fingerprint == m_pvrFingerprint)
+  {
+    LOG_DEBUG("%s recordings unchanged since the last load", __FUNCTION__);
+    return true;
+  }
+
+  ApplyRecordings(root, false);
+  return true;
+}
+
+void CatalogManager::ApplyRecordings(const Json::Value & root, bool stored)
+{
+  TraceSpan span{"ApplyRecordings"};
+  decltype (m_catalog.channels) channels;
+  decltype (m_catalog.recordings) recordings;
+  decltype (m_catalog.timers) timers;
+  {
+    std::lock_guard<std::mutex> critical(m_mutex);
+    channels = m_catalog.channels;
+    recordings = m_catalog.recordings;
+    timers = m_catalog.timers;
+  }
+
+  auto new_recordings = std::make_shared<recording_container_t>();
+  auto new_timers = std::make_shared<timer_container_t>();
+  long long available_duration = 0;
+  long long recorded_duration = 0;
+  ParseRecords(root, *channels, time(nullptr), m_settings.lockedDirectory, *new_recordings, *new_timers, available_duration, recorded_duration);
+
+  const auto recordings_diff = DiffById(*recordings, *new_recordings, [] (const Recording & r) { return r.strRecordId; });
+  const auto timers_diff = DiffById(*timers, *new_timers, [] (const Timer & t) { return t.iClientIndex; });
+  const bool changed_r = !recordings_diff.empty();
+  const bool changed_t = !timers_diff.empty();
+  LOG_DEBUG("%s recordings added=%u removed=%u modified=%u, timers added=%u removed=%u modified=%u", __FUNCTION__
+      , static_cast<unsigned>(recordings_diff.added.size()), static_cast<unsigned>(recordings_diff.removed.size()), static_cast<unsigned>(recordings_diff.modified.size())
+      , static_cast<unsigned>(timers_diff.added.size()), static_cast<unsigned>(timers_diff.removed.size()), static_cast<unsigned>(timers_diff.modified.size()));
+
+  if (changed_r)
+  {
+    // forget stream info of not valid recordings
+    std::lock_guard<std::mutex> critical(m_mutex);
+    for (const auto & record_id : recordings_diff.removed)
+      m_recordingStreams.erase(record_id);
+    for (const auto & record_id : recordings_diff.modified)
+      m_recordingStreams.erase(record_id);
+  }
+  if (!stored && !recordings->empty() && recordings_diff.added.size() <= RECORDING_PREFETCH_MAX)
+  {
+    // prefetch stream info of (just a few) newly added recordings,
+    // others are resolved on demand
+    StreamInfo info;
+    for (const auto & recording : *new_recordings)
+    {
+      if (!recording.bIsPinLocked && 0 < recordings_diff.added.count(recording.strRecordId))
+        RecordingStreamInfo(recording.strRecordId, info);
+    }
+  }
+  {
+    std::lock_guard<std::mutex> critical(m_mutex);
+    if (changed_r)
+      SetRecordings(std::move(new_recordings));
+
+    if (changed_t)
+    {
+      m_catalog.timers = std::move(new_timers);
+      m_nextTimerTransition = 0;
+    }
+    m_recordingAvailableDuration = available_duration;
+    m_recordingRecordedDuration = recorded_duration;
+  }
+  if (!stored)
+  {
+    if (changed_r)
+      m_sink.RecordingsChanged();
+    if (changed_t)
+      m_sink.TimersChanged();
+  }
+}
+
+bool CatalogManager::TimeShiftPrefetchJob()
+{
+  const time_t now = time(nullptr);
+  decltype (m_recentChannels) recent_channels;
+  decltype (m_catalog.epg) epg;
+  {
+    std::lock_guard<std::mutex> critical(m_mutex);
+    if (m_bOffline || (0 != m_nextTimeShiftPrefetch && now < m_nextTimeShiftPrefetch))
+      return false;
+    recent_channels = m_recentChannels;
+    epg = m_catalog.epg;
+  }
+
+  time_t next_prefetch = std::numeric_limits<time_t>::max();
+  for (const auto & channel_id : recent_channels)
+  {
+    auto epg_channel_i = epg->find(channel_id);
+    if (epg->cend() == epg_channel_i)
+      continue;
+    const auto & entries = epg_channel_i->second.epg;
+    // the currently airing programme
+    auto entry_i = entries.upper_bound(now);
+    if (entries.cbegin() == entry_i)
+      continue;
+    --entry_i;
+    const EpgEntry & entry = entry_i->second;
+    if (now >= entry.endTime)
+      continue;
+
+    // recorded events are played from the recording
+    if (entry.availableTimeshift && !entry.strEventId.empty() && entry.strRecordId.empty())
+    {
+      StreamInfo info;
+      if (TimeShiftStreamInfo(entry.strEventId, info))
+      {
+        LOG_DEBUG("%s pre-resolved '%s' on channel %s", __FUNCTION__, entry.strTitle.c_str(), channel_id.c_str());
+        next_prefetch = std::min(next_prefetch, info.expires);
+      } else
+      {
+        next_prefetch = std::min(next_prefetch, now + TIMESHIFT_PREFETCH_RETRY);
+      }
+    }
+    next_prefetch = std::min(next_prefetch, entry.endTime);
+  }
+
+  std::lock_guard<std::mutex> critical(m_mutex);
+  // check if the recent channels weren't changed meanwhile
+  if (m_recentChannels == recent_channels)
+    m_nextTimeShiftPrefetch = next_prefetch;
+  return true;
+}
+
+void CatalogManager::SetRecentChannel(const std::string & channelId)
+{
+  std::lock_guard<std::mutex> critical(m_mutex);
+  auto recent_i = std::find(m_recentChannels.begin(), m_recentChannels.end(), channelId);
+  if (m_recentChannels.begin() == recent_i)
+    return;
+  if (m_recentChannels.end() != recent_i)
+    m_recentChannels.erase(recent_i);
+  m_recentChannels.push_front(channelId);
+  if (m_recentChannels.size() > RECENT_CHANNELS_MAX)
+    m_recentChannels.pop_back();
+  m_nextTimeShiftPrefetch = 0;
+}
+
+bool CatalogManager::TimersTransitionJob()
+{
+  const time_t now = time(nullptr);
+  decltype (m_catalog.timers) timers;
+  {
+    std::lock_guard<std::mutex> critical(m_mutex);
+    if (0 != m_nextTimerTransition && now < m_nextTimerTransition)
+      return false;
+    timers = m_catalog.timers;
+  }
+
+  auto new_timers = std::make_shared<timer_container_t>(*timers);
+  bool changed_t = false;
+  bool finished = false;
+  time_t next_transition = std::numeric_limits<time_t>::max();
+  for (auto & timer : *new_timers)
+  {
+    if (timer.endTime <= now)
+    {
+      // the recording is finished -> must be reloaded from backend
+      LOG_DEBUG("Timer '%s' finished", timer.strTitle.c_str());
+      finished = true;
+      continue;
+    }
+    if (timer.state == PVR_TIMER_STATE_SCHEDULED && timer.startTime <= now)
+    {
+      LOG_DEBUG("Timer '%s' started recording", timer.strTitle.c_str());
+      timer.state = PVR_TIMER_STATE_RECORDING;
+      changed_t = true;
+    }
+    next_transition = std::min(next_transition, timer.state == PVR_TIMER_STATE_SCHEDULED ? timer.startTime : timer.endTime);
+  }
+
+  {
+    std::lock_guard<std::mutex> critical(m_mutex);
+    // check if the timers weren't changed meanwhile
+    if (m_catalog.timers != timers)
+      return false;
+    m_nextTimerTransition = next_transition;
+    if (changed_t)
+      m_catalog.timers = std::move(new_timers);
+  }
+  if (changed_t)
+    m_sink.TimersChanged();
+  if (finished)
+  {
+    // the same response must be re-evaluated (timer -> recording)
+    m_pvrFingerprint = 0;
+    SetLoadRecordings();
+  }
+
+  return changed_t || finished;
+}
+
+void CatalogManager::DumpStats() const
+{
+  const std::string report = m_manager->stats().Report();
+  Log(LL_INFO, "API statistics:\n%s", report.c_str());
+  m_fileSystem->WriteFile(InstanceFilePath(API_STATS_FILE), report);
+  Log(LL_INFO, "Catalog memory:\n%s", CatalogMemoryReport(false).c_str());
+  m_fileSystem->WriteFile(InstanceFilePath(CATALOG_STATS_FILE), CatalogMemoryReport(true));
+}
+
+std::string CatalogManager::CatalogMemoryReport(bool perChannel) const
+{
+  CatalogSnapshot catalog;
+  decltype (m_drmCertificate) drm_certificate;
+  size_t stream_caches_count, stream_caches_size;
+  int future_days, past_days;
+  {
+    std::lock_guard<std::mutex> critical(m_mutex);
+    catalog = m_catalog;
+    drm_certificate = m_drmCertificate;
+    // the caches are not snapshots, must be accounted under the lock
+    stream_caches_count = m_recordingStreams.size() + m_timeShiftStreams.size();
+    stream_caches_size = HeapSize(m_recordingStreams) + HeapSize(m_timeShiftStreams);
+    future_days = m_epgMaxFutureDays;
+    past_days = m_epgMaxPastDays;
+  }
+
+  size_t properties_count = 0;
+  for (const auto & properties : *catalog.channelsProperties)
+    properties_count += properties.second.size();
+  size_t epg_entries = 0;
+  for (const auto & epg_channel : *catalog.epg)
+    epg_entries += epg_channel.second.epg.size();
+
+  std::string report;
+  char line[128];
+  size_t total = 0;
+  auto add_line = [&report, &line, &total] (const char * name, size_t count, size_t size) {
+    std::snprintf(line, sizeof (line), "%-22s %9u %11.1f\n", name, static_cast<unsigned>(count), size / 1024.0);
+    report += line;
+    total += size;
+  };
+  std::snprintf(line, sizeof (line), "%-22s %9s %11s\n", "snapshot", "entries", "heap[kB]");
+  report += line;
+  add_line("channels", catalog.channels->size(), HeapSize(*catalog.channels));
+  add_line("channels index", catalog.channelsIndex->size(), HeapSize(*catalog.channelsIndex));
+  add_line("stream properties", properties_count, HeapSize(*catalog.channelsProperties));
+  add_line("groups", catalog.groups->size(), HeapSize(*catalog.groups));
+  add_line("groups index", catalog.groupsIndex->size(), HeapSize(*catalog.groupsIndex));
+  add_line("EPG", epg_entries, HeapSize(*catalog.epg));
+  add_line("recordings", catalog.recordings->size(), HeapSize(*catalog.recordings));
+  add_line("recordings index", catalog.recordingsIndex->size(), HeapSize(*catalog.recordingsIndex));
+  add_line("timers", catalog.timers->size(), HeapSize(*catalog.timers));
+  add_line("stream info caches", stream_caches_count, stream_caches_size);
+  add_line("DRM certificate", drm_certificate ? 1 : 0, drm_certificate ? HeapSize(*drm_certificate) : 0);
+  std::snprintf(line, sizeof (line), "%-22s %9s %11.1f (EPG window -%d..+%d days, %u channels)\n", "total", "", total / 1024.0
+      , past_days, future_days, static_cast<unsigned>(catalog.epg->size()));
+  report += line;
+
+  if (perChannel)
+  {
+    std::snprintf(line, sizeof (line), "\n%-22s %9s %11s\n", "EPG channel", "entries", "heap[kB]");
+    report += line;
+    for (const auto & epg_channel : *catalog.epg)
+    {
+      std::snprintf(line, sizeof (line), "%-22s %9u %11.1f\n", epg_channel.first.c_str()
+          , static_cast<unsigned>(epg_channel.second.epg.size()), HeapSize(epg_channel.second) / 1024.0);
+      report += line;
+    }
+  }
+  return report;
+}
+
+std::string CatalogManager::InstanceFilePath(const std::string & name) const
+{
+  return m_fileSystem->UserPath(name + '-' + std::to_string(m_instanceNo));
+}
+
+void CatalogManager::LoadChannelUids()
+{
+  std::string content;
+  Json::Value root;
+  if (!m_fileSystem->ReadFile(InstanceFilePath(CHANNEL_UIDS_FILE), content) || !ParseJson(content, root) || !root.isObject())
+    return;
+  for (const auto & channel_id : root.getMemberNames())
+  {
+    const int uid = root[channel_id].asInt();
+    if (0 < uid && m_usedChannelUids.insert(uid).second)
+      m_channelUids[channel_id] = uid;
+  }
+  LOG_DEBUG("%s loaded %u channel unique ids", __FUNCTION__, static_cast<unsigned>(m_channelUids.size()));
+}
+
+void CatalogManager::SaveChannelUids() const
+{
+  Json::Value root{Json::objectValue};
+  for (const auto & uid : m_channelUids)
+    root[uid.first] = uid.second;
+  std::ostringstream os;
+  os << root;
+  m_fileSystem->WriteFile(InstanceFilePath(CHANNEL_UIDS_FILE), os.str());
+}
+
+int CatalogManager::ChannelUniqueId(const std::string & channelId, bool & newlyAssigned)
+{
+  newlyAssigned = false;
+  const auto uid_i = m_channelUids.find(channelId);
+  if (m_channelUids.cend() != uid_i)
+    return uid_i->second;
+
+  // FNV-1a hash of the channel id, kept positive (as Kodi expects) and non-zero
+  uint32_t hash = 2166136261u;
+  for (const unsigned char c : channelId)
+  {
+    hash ^= c;
+    hash *= 16777619u;
+  }
+  int uid = static_cast<int>(hash & 0x7fffffff);
+  // resolve collisions by probing (the result is persisted, so it stays stable)
+  while (0 == uid || 0 < m_usedChannelUids.count(uid))
+    uid = (uid + 1) & 0x7fffffff;
+
+  m_channelUids[channelId] = uid;
+  m_usedChannelUids.insert(uid);
+  newlyAssigned = true;
+  return uid;
+}
+
+bool CatalogManager::LoadPlayList()
+{
+  if (!KeepAlive())
+    return false;
+
+  TraceSpan span{"LoadPlayList"};
+
+  Json::Value root;
+
+  const ApiManager::Fingerprint_t last_fingerprint = m_playlistFingerprint;
+  if (!m_manager->getPlaylist(m_settings.streamQuality, m_settings.useH265, m_settings.useAdaptive, root, m_playlistFingerprint))
+  {
+    Log(LL_INFO, "Cannot get/parse playlist.");
+    return false;
+  }
+  {
+    std::lock_guard<std::mutex> critical(m_mutex);
+    m_catalogTime = time(nullptr);
+  }
+  if (last_fingerprint == m_playlistFingerprint)
+  {
+    LOG_DEBUG("%s playlist unchanged since the last load", __FUNCTION__);
+    {
+      std::lock_guard<std::mutex> critical(m_mutex);
+      m_bChannelsLoaded = true;
+    }
+    m_waitCond.notify_all();
+    return true;
+  }
+
+  ApplyPlayList(root, false);
+  return true;
+}
+
+void CatalogManager::ApplyPlayList(const Json::Value & root, bool stored)
+{
+  TraceSpan span{"ApplyPlayList"};
+  auto new_channels = std::make_shared<channel_container_t>();
+  auto new_groups = std::make_shared<group_container_t>();
+  auto new_groups_index = std::make_shared<group_index_t>();
+  bool uids_changed = false;
+  ParsePlayList(root, m_settings.showLockedChannels, m_settings.showLockedOnlyPin
+      , [this, &uids_changed] (const std::string & channelId) {
+        bool newly_assigned;
+        const int uid = ChannelUniqueId(channelId, newly_assigned);
+        uids_changed |= newly_assigned;
+        return uid;
+      }
+      , *new_channels, *new_groups, *new_groups_index);
+
+  if (uids_changed)
+    SaveChannelUids();
+
+  const size_t channel_count = new_channels->size();
+  Log(LL_INFO, "Loaded %u%s channels.", static_cast<unsigned>(channel_count), stored ? " stored" : "");
+
+  auto new_channels_index = std::make_shared<channel_index_t>(channel_count);
+  for (size_t i = 0; i < channel_count; ++i)
+    new_channels_index->emplace((*new_channels)[i].iUniqueId, i);
+
+  {
+    std::lock_guard<std::mutex> critical(m_mutex);
+    m_catalog.channels = std::move(new_channels);
+    m_catalog.channelsIndex = std::move(new_channels_index);
+    // properties are recomputed for the new channels
+    m_catalog.channelsProperties = std::make_shared<channel_properties_t>();
+    m_catalog.groups = std::move(new_groups);
+    m_catalog.groupsIndex = std::move(new_groups_index);
+    m_bChannelsLoaded = true;
+    if (0 > m_startup.channels.count())
+      m_startup.storedChannels = stored;
+  }
+  m_waitCond.notify_all();
+  StartupMilestone(&StartupMetrics::channels);
+  UpdateChannelsProperties();
+  if (!stored)
+    m_sink.ChannelsChanged(channel_count);
+
+  // EPG & recordings are bound to channels, so they must be really reloaded
+  m_epgFingerprints.clear();
+  m_pvrFingerprint = 0;
+}
+
+std::shared_ptr<const stream_properties_t> CatalogManager::ChannelStreamProperties(const CatalogSnapshot & catalog, int channelUid) const
+{
+  const auto properties_i = catalog.channelsProperties->find(channelUid);
+  if (catalog.channelsProperties->cend() != properties_i)
+    return {catalog.channelsProperties, &properties_i->second}; // sharing the ownership of the snapshot, no copy
+  // not precomputed (DRM registration not finished yet)
+  const auto index_i = catalog.channelsIndex->find(channelUid);
+  if (catalog.channelsIndex->cend() == index_i)
+    return nullptr;
+  const Channel & chan = (*catalog.channels)[index_i->second];
+  return std::make_shared<stream_properties_t>(StreamProperties(chan.strStreamURL, chan.strStreamType, chan.bIsDrm, true));
+}
+
+bool CatalogManager::FindEpgEntry(const CatalogSnapshot & catalog, int channelUid, unsigned broadcastId, const Channel *& channel, const EpgEntry *& entry)
+{
+  const auto index_i = catalog.channelsIndex->find(channelUid);
+  if (catalog.channelsIndex->cend() == index_i)
+  {
+    Log(LL_INFO, "%s can't find channel %d", __FUNCTION__, channelUid);
+    return false;
+  }
+  channel = &(*catalog.channels)[index_i->second];
+
+  const auto ch_epg_i = catalog.epg->find(channel->strId);
+  if (catalog.epg->cend() == ch_epg_i)
+  {
+    Log(LL_INFO, "%s can't find EPG data for channel %s", __FUNCTION__, channel->strId.c_str());
+    return false;
+  }
+  const auto epg_i = ch_epg_i->second.epg.find(broadcastId);
+  if (ch_epg_i->second.epg.cend() == epg_i)
+  {
+    Log(LL_INFO, "%s can't find EPG data for channel %s, time %u", __FUNCTION__, channel->strId.c_str(), broadcastId);
+    return false;
+  }
+  entry = &epg_i->second;
+  return true;
+}
+
+void CatalogManager::ExtendEpgWindow(time_t start, time_t end)
+{
+  std::lock_guard<std::mutex> critical(m_mutex);
+  m_epgMinTime = start < m_epgMinTime ? start : m_epgMinTime;
+  m_epgMaxTime = end > m_epgMaxTime ? end : m_epgMaxTime;
+}
+
+void CatalogManager::SetEPGMaxDays(int iFutureDays, int iPastDays)
+{
+  LOG_DEBUG("%s iFutureDays=%d, iPastDays=%d", __FUNCTION__, iFutureDays, iPastDays);
+  time_t now = time(nullptr);
+  std::lock_guard<std::mutex> critical(m_mutex);
+  m_epgMaxFutureDays = (iFutureDays == -1 ? m_epgMaxFutureDays : iFutureDays);
+  m_epgMaxPastDays = (iPastDays == -1 ? m_epgMaxPastDays : iPastDays);
+  m_epgMinTime = now - m_epgMaxPastDays * 86400;
+  m_epgMaxTime = now + m_epgMaxFutureDays * 86400;
+}
+
+bool CatalogManager::RecordingStreamInfo(const std::string & recordId, StreamInfo & info)
+{
+  const time_t now = time(nullptr);
+  {
+    std::lock_guard<std::mutex> critical(m_mutex);
+    auto info_i = m_recordingStreams.find(recordId);
+    if (m_recordingStreams.cend() != info_i && now < info_i->second.expires)
+    {
+      info = info_i->second;
+      return true;
+    }
+  }
+
+  info.bIsDrm = false;
+  info.iDuration = 0;
+  info.strStreamUrl = m_manager->getRecordingUrl(recordId, info.strChannelId, info.bIsDrm);
+  if (info.strStreamUrl.empty())
+    return false;
+  // get the stream type based on channel
+  info.strStreamType = ChannelStreamType(info.strChannelId);
+  info.expires = now + RECORDING_STREAM_TTL;
+
+  std::lock_guard<std::mutex> critical(m_mutex);
+  CacheStreamInfo(m_recordingStreams, recordId, info, RECORDING_STREAMS_MAX, now);
+  return true;
+}
+
+bool CatalogManager::TimeShiftStreamInfo(const std::string & eventId, StreamInfo & info)
+{
+  const time_t now = time(nullptr);
+  {
+    std::lock_guard<std::mutex> critical(m_mutex);
+    auto info_i = m_timeShiftStreams.find(eventId);
+    if (m_timeShiftStreams.cend() != info_i && now < info_i->second.expires)
+    {
+      info = info_i->second;
+      return true;
+    }
+  }
+
+  if (!m_manager->getTimeShiftInfo(eventId, info.strStreamUrl, info.strChannelId, info.iDuration))
+    return false;
+  // get the stream type based on channel
+  info.strStreamType = ChannelStreamType(info.strChannelId);
+  info.bIsDrm = false; // taken from the channel
+  info.expires = now + TIMESHIFT_STREAM_TTL;
+
+  std::lock_guard<std::mutex> critical(m_mutex);
+  CacheStreamInfo(m_timeShiftStreams, eventId, info, TIMESHIFT_STREAMS_MAX, now);
+  return true;
+}
+
+bool CatalogManager::RecordingExists(const std::string & recordId) const
+{
+  decltype (m_catalog.recordingsIndex) recordings_index;
+  {
+    std::lock_guard<std::mutex> critical(m_mutex);
+    recordings_index = m_catalog.recordingsIndex;
+  }
+  return 0 < recordings_index->count(recordId);
+}
+
+void CatalogManager::SetRecordings(std::shared_ptr<const recording_container_t> recordings)
+{
+  auto recordings_index = std::make_shared<recording_index_t>(recordings->size());
+  for (size_t i = 0; i < recordings->size(); ++i)
+    recordings_index->emplace((*recordings)[i].strRecordId, i);
+
+  m_catalog.recordings = std::move(recordings);
+  m_catalog.recordingsIndex = std::move(recordings_index);
+}
+
+bool CatalogManager::PinUnlocked() const
+{
+  return m_manager->pinUnlocked();
+}
+
+bool CatalogManager::PinUnlock(const std::string & pin)
+{
+  if (!m_manager->pinUnlock(pin))
+  {
+    Log(LL_ERROR, "PIN-unlocking failed");
+    return false;
+  }
+  SetLoadPlaylist();
+  WaitForChannels();
+  return true;
+}
+
+bool CatalogManager::AddTimer(int channelUid, time_t startTime)
+{
+  const CatalogSnapshot catalog = Snapshot();
+
+  const auto index_i = catalog.channelsIndex->find(channelUid);
+  if (catalog.channelsIndex->cend() == index_i)
+  {
+    Log(LL_ERROR, "%s - channel not found", __FUNCTION__);
+    return false;
+  }
+  const Channel & channel = (*catalog.channels)[index_i->second];
+  const auto epg_channel_i = catalog.epg->find(channel.strId);
+  if (epg_channel_i == catalog.epg->cend())
+  {
+    Log(LL_ERROR, "%s - epg channel not found", __FUNCTION__);
+    return false;
+  }
+
+  const auto epg_i = epg_channel_i->second.epg.find(startTime);
+  if (epg_i == epg_channel_i->second.epg.cend())
+  {
+    Log(LL_ERROR, "%s - event not found", __FUNCTION__);
+    return false;
+  }
+
+  const EpgEntry & epg_entry = epg_i->second;
+  std::string record_id;
+  if (!m_manager->addTimer(epg_entry.strEventId, record_id))
+    return false;
+
+  // update the record_id into EPG
+  // Note: the published epg is read-only, so the keys must exist
+  auto epg_copy = std::make_shared<epg_container_t>(*catalog.epg);
+  (*epg_copy)[channel.strId].epg[startTime].strRecordId = record_id;
+  {
+    std::lock_guard<std::mutex> critical(m_mutex);
+    m_catalog.epg = epg_copy;
+  }
+
+  // optimistically add the timer/recording, the backend state will be reconciled later
+  std::string directory;
+  if (channel.bIsPinLocked)
+  {
+    directory = m_settings.lockedDirectory;
+    directory += " - pin";
+  }
+  const time_t now = time(nullptr);
+  if (epg_entry.endTime < now)
+  {
+    Recording iptvrecording;
+    iptvrecording.strRecordId = record_id;
+    iptvrecording.strTitle = epg_entry.strTitle;
+    iptvrecording.strChannelName = channel.strChannelName;
+    iptvrecording.iChannelUid = channel.iUniqueId;
+    iptvrecording.startTime = epg_entry.startTime;
+    iptvrecording.strPlotOutline = epg_entry.strPlot;
+    iptvrecording.duration = epg_entry.endTime - epg_entry.startTime;
+    iptvrecording.bRadio = channel.bIsRadio;
+    iptvrecording.iLifeTime = 0;
+    iptvrecording.strDirectory = std::move(directory);
+    iptvrecording.bIsPinLocked = channel.bIsPinLocked;
+
+    {
+      std::lock_guard<std::mutex> critical(m_mutex);
+      auto new_recordings = std::make_shared<recording_container_t>(*m_catalog.recordings);
+      new_recordings->push_back(std::move(iptvrecording));
+      SetRecordings(std::move(new_recordings));
+    }
+    m_sink.RecordingsChanged();
+  } else
+  {
+    Timer iptvtimer;
+    iptvtimer.iClientIndex = std::strtoul(record_id.c_str(), nullptr, 10);
+    iptvtimer.iClientChannelUid = channel.iUniqueId;
+    iptvtimer.startTime = epg_entry.startTime;
+    iptvtimer.endTime = epg_entry.endTime;
+    iptvtimer.state = epg_entry.startTime < now ? PVR_TIMER_STATE_RECORDING : PVR_TIMER_STATE_SCHEDULED;
+    iptvtimer.strTitle = epg_entry.strTitle;
+    iptvtimer.iLifeTime = 0;
+    iptvtimer.strDirectory = std::move(directory);
+
+    {
+      std::lock_guard<std::mutex> critical(m_mutex);
+      auto new_timers = std::make_shared<timer_container_t>(*m_catalog.timers);
+      new_timers->push_back(std::move(iptvtimer));
+      m_catalog.timers = std::move(new_timers);
+      m_nextTimerTransition = 0;
+    }
+    m_sink.TimersChanged();
+  }
+  SetLoadRecordingsDeferred();
+  return true;
+}
+
+bool CatalogManager::DeleteRecording(const std::string & recordId)
+{
+  if (!m_manager->deleteRecord(recordId))
+    return false;
+  {
+    std::lock_guard<std::mutex> critical(m_mutex);
+    auto new_recordings = std::make_shared<recording_container_t>(*m_catalog.recordings);
+    new_recordings->erase(std::remove_if(new_recordings->begin(), new_recordings->end(), [&recordId] (const Recording & r) { return r.strRecordId == recordId; })
+        , new_recordings->end());
+    SetRecordings(std::move(new_recordings));
+  }
+  m_sink.RecordingsChanged();
+  SetLoadRecordingsDeferred();
+  return true;
+}
+
+bool CatalogManager::DeleteTimer(unsigned clientIndex)
+{
+  if (!m_manager->deleteRecord(std::to_string(clientIndex)))
+    return false;
+  {
+    std::lock_guard<std::mutex> critical(m_mutex);
+    auto new_timers = std::make_shared<timer_container_t>(*m_catalog.timers);
+    new_timers->erase(std::remove_if(new_timers->begin(), new_timers->end(), [clientIndex] (const Timer & t) { return t.iClientIndex == clientIndex; })
+        , new_timers->end());
+    m_catalog.timers = std::move(new_timers);
+    m_nextTimerTransition = 0;
+  }
+  m_sink.TimersChanged();
+  SetLoadRecordingsDeferred();
+  return true;
+}
+
+stream_properties_t CatalogManager::StreamProperties(const std::string & url, const std::string & streamType, bool isDrm, bool isLive) const
+{
+  decltype (m_drmCertificate) certificate;
+  decltype (m_drmLicenseUrl) licenseUrl;
+  if (isDrm && m_settings.useAdaptive)
+  {
+    // the DRM registration runs in background, wait for it (if needed)
+    std::unique_lock<std::mutex> critical(m_mutex);
+    m_waitCond.wait_for(critical, std::chrono::seconds{10}, [this] { return m_drmCertificate && m_drmLicenseUrl; });
+    certificate = m_drmCertificate;
+    licenseUrl = m_drmLicenseUrl;
+  }
+  return BuildStreamProperties(url, streamType, isDrm, isLive, certificate.get(), licenseUrl.get());
+}
+
+stream_properties_t CatalogManager::BuildStreamProperties(const std::string & url, const std::string & streamType, bool isDrm, bool isLive
+    , const std::string * certificate, const std::string * licenseUrl) const
+{
+  static const std::set<std::string> ADAPTIVE_TYPES = {"mpd", "ism", "hls"};
+
+  stream_properties_t properties;
+  properties.push_back({PVR_STREAM_PROPERTY_STREAMURL, url});
+  if (m_settings.useAdaptive && 0 < ADAPTIVE_TYPES.count(streamType))
+  {
+    properties.push_back({PVR_STREAM_PROPERTY_INPUTSTREAM, "inputstream.adaptive"});
+    if (isDrm)
+    {
+      if (nullptr == certificate || nullptr == licenseUrl)
+      {
+        Log(LL_WARNING, "DRM registration not available (yet). DRM will not work");
+      } else
+      {
+        properties.push_back({"inputstream.adaptive.license_type", "com.widevine.alpha"});
+        properties.push_back({"inputstream.adaptive.server_certificate", *certificate});
+        std::string license_url{*licenseUrl};
+        license_url += ApiManager::urlEncode(base64::to_base64(url));
+        properties.push_back({"inputstream.adaptive.license_key", std::move(license_url)});
+      }
+    }
+  }
+  if (isLive)
+    properties.push_back({PVR_STREAM_PROPERTY_ISREALTIMESTREAM, "true"});
+  return properties;
+}
+
+void CatalogManager::UpdateChannelsProperties()
+{
+  decltype (m_catalog.channels) channels;
+  decltype (m_drmCertificate) certificate;
+  decltype (m_drmLicenseUrl) licenseUrl;
+  {
+    std::lock_guard<std::mutex> critical(m_mutex);
+    channels = m_catalog.channels;
+    certificate = m_drmCertificate;
+    licenseUrl = m_drmLicenseUrl;
+  }
+
+  auto channels_properties = std::make_shared<channel_properties_t>(channels->size());
+  for (const auto & channel : *channels)
+  {
+    // DRM channels without DRM data are resolved on demand (waiting for registration)
+    if (channel.bIsDrm && (!certificate || !licenseUrl))
+      continue;
+    channels_properties->emplace(channel.iUniqueId, BuildStreamProperties(channel.strStreamURL, channel.strStreamType, channel.bIsDrm, true, certificate.get(), licenseUrl.get()));
+  }
+
+  std::lock_guard<std::mutex> critical(m_mutex);
+  // check if the channels weren't changed meanwhile
+  if (m_catalog.channels == channels)
+    m_catalog.channelsProperties = std::move(channels_properties);
+}
+
+std::string CatalogManager::ChannelStreamType(const std::string & channelId) const
+{
+  decltype (m_catalog.channels) channels;
+  {
+    std::lock_guard<std::mutex> critical(m_mutex);
+    channels = m_catalog.channels;
+  }
+
+  std::string stream_type = "unknown";
+  auto channel_i = std::find_if(channels->cbegin(), channels->cend(), [&channelId] (const Channel & c) { return c.strId == channelId; });
+  if (channels->cend() == channel_i)
+    Log(LL_INFO, "%s can't find channel %s", __FUNCTION__, channelId.c_str());
+  else
+    stream_type = channel_i->strStreamType;
+  return stream_type;
+}
+
+} // namespace sledovanitvcz
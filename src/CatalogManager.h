@@ -0,0 +1,282 @@
+/*
+ *      Copyright (c) 2018~now Palo Kisa <palo.kisa@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this addon; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#ifndef sledovanitvcz_CatalogManager_h
+#define sledovanitvcz_CatalogManager_h
+
+#include "ApiManager.h"
+#include "Catalog.h"
+#include "Platform.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+/*!
+ * \file The published catalog (read-only snapshots of channels, EPG,
+ * recordings, timers) and the background jobs keeping it in sync with the
+ * backend. This is the core (Kodi independent) part of the addon, the Kodi
+ * adapter (Data) converts the snapshots into the Kodi types and forwards the
+ * notifications of the \sa CatalogSink.
+ */
+
+namespace Json
+{
+  class Value;
+}
+
+namespace sledovanitvcz
+{
+
+enum ConnectionState_t
+{
+  CS_CONNECTED
+    , CS_OFFLINE //!< backend unreachable, the stored data are served
+    , CS_DISCONNECTED
+};
+
+//! Receiver of the catalog notifications (e.g. the Kodi callbacks)
+class CatalogSink
+{
+public:
+  virtual ~CatalogSink() = default;
+  virtual void ConnectionChanged(ConnectionState_t state) = 0;
+  //! New channels (and groups) from backend were published
+  virtual void ChannelsChanged(size_t channelCount) = 0;
+  virtual void RecordingsChanged() = 0;
+  virtual void TimersChanged() = 0;
+  virtual void EpgChanged(const EpgEntry & entry, EpgChange_t change) = 0;
+};
+
+//! Consistent set of the published snapshots
+struct CatalogSnapshot
+{
+  std::shared_ptr<const group_container_t> groups;
+  std::shared_ptr<const group_index_t> groupsIndex; //!< index of groups by names
+  std::shared_ptr<const channel_container_t> channels;
+  std::shared_ptr<const channel_index_t> channelsIndex; //!< index of channels by unique ids
+  std::shared_ptr<const channel_properties_t> channelsProperties; //!< precomputed live stream properties of channels
+  std::shared_ptr<const epg_container_t> epg;
+  std::shared_ptr<const recording_container_t> recordings;
+  std::shared_ptr<const recording_index_t> recordingsIndex; //!< index of recordings by ids
+  std::shared_ptr<const timer_container_t> timers;
+};
+
+//! Milestones of the startup critical path (durations since the construction, negative - not reached)
+struct StartupMetrics
+{
+  std::chrono::steady_clock::time_point created = std::chrono::steady_clock::now();
+  std::chrono::steady_clock::duration connected{-1}; //!< the first successful login
+  std::chrono::steady_clock::duration channels{-1}; //!< channels published (m_bChannelsLoaded)
+  std::chrono::steady_clock::duration epg{-1}; //!< the first EPG published by LoadEPG
+  std::chrono::steady_clock::duration waitBlocked{0}; //!< the time the callers spent in WaitForChannels
+  unsigned waits = 0; //!< count of the blocking WaitForChannels
+  bool storedChannels = false; //!< flag if the first channels were the stored ones
+  bool reported = false;
+};
+
+class CatalogManager
+{
+public:
+  struct Settings
+  {
+    ApiManager::StreamQuality_t streamQuality = ApiManager::SQ_DEFAULT;
+    unsigned fullChannelEpgRefresh = 24 * 3600; //!< delay (seconds) between full channel/EPG refresh
+    unsigned loadingsRefresh = 600; //!< delay (seconds) between loadings refresh
+    unsigned keepAliveDelay = 20; //!< delay (seconds) between keepalive calls
+    unsigned epgCheckDelay = 60; //!< delay (seconds) between checking if EPG load is needed
+    unsigned statsInterval = 0; //!< delay (seconds) between statistics dumps, 0 - disabled
+    bool useH265 = false; //!< flag, if h265 codec should be requested
+    bool useAdaptive = false; //!< flag, if inpustream.adaptive (aka adaptive bitrate streaming) should be used/requested
+    bool showLockedChannels = true; //!< flag, if unavailable/locked channels should be presented
+    bool showLockedOnlyPin = true; //!< flag, if PIN-locked only channels should be presented
+    int epgMaxFutureDays = 3;
+    int epgMaxPastDays = 3;
+    std::string lockedDirectory; //!< the directory (prefix) for records on locked channels
+  };
+
+  CatalogManager(std::shared_ptr<ApiManager> manager
+      , std::shared_ptr<FileSystem> fileSystem
+      , uint64_t instanceNo
+      , const Settings & settings
+      , CatalogSink & sink
+      );
+  ~CatalogManager();
+
+  //! Publish the stored data (the last known) and start the job thread
+  void Start();
+  //! Stop the job thread, store the EPG and write the final statistics
+  void Stop();
+
+  // the published data
+  CatalogSnapshot Snapshot() const;
+  void DriveSpace(long long & available, long long & recorded) const;
+  //! \return flag if the backend is unreachable and the stored data are served
+  bool Offline() const;
+  //! \return age (seconds) of the published channels data (0 - nothing published)
+  time_t CatalogAge() const;
+  //! \return the EPG window loaded from backend (false - nothing loaded)
+  bool EpgCoverage(time_t & start, time_t & end) const;
+  bool LoggedIn() const;
+  const ApiManager & Api() const;
+  //! Find the \param broadcastId entry on the \param channelUid channel
+  static bool FindEpgEntry(const CatalogSnapshot & catalog, int channelUid, unsigned broadcastId, const Channel *& channel, const EpgEntry *& entry);
+  bool RecordingExists(const std::string & recordId) const;
+  //! \return false if channels are not published even after the waiting
+  bool WaitForChannels() const;
+
+  // the requests
+  void SetEPGMaxDays(int iFutureDays, int iPastDays);
+  //! Extend the EPG window (never narrowed by the request)
+  void ExtendEpgWindow(time_t start, time_t end);
+  void SetLoadRecordings();
+  //! Request the recordings (re)load after a short delay (to reconcile our local changes with backend)
+  void SetLoadRecordingsDeferred();
+  void SetLoadPlaylist();
+  void SetRecentChannel(const std::string & channelId);
+  bool PinUnlocked() const;
+  //! Unlock the PIN-locked channels (reloads the channels & recordings)
+  bool PinUnlock(const std::string & pin);
+  bool AddTimer(int channelUid, time_t startTime);
+  bool DeleteRecording(const std::string & recordId);
+  bool DeleteTimer(unsigned clientIndex);
+
+  // the streams
+  //! \return the live stream properties of the \param channelUid (pointing into the \param catalog if precomputed, built otherwise),
+  //! nullptr if not found
+  std::shared_ptr<const stream_properties_t> ChannelStreamProperties(const CatalogSnapshot & catalog, int channelUid) const;
+  stream_properties_t StreamProperties(const std::string & url, const std::string & streamType, bool isDrm, bool isLive) const;
+  stream_properties_t BuildStreamProperties(const std::string & url, const std::string & streamType, bool isDrm, bool isLive
+      , const std::string * certificate, const std::string * licenseUrl) const;
+  //! Get the recording stream info from cache or resolve it (and cache it)
+  bool RecordingStreamInfo(const std::string & recordId, StreamInfo & info);
+  //! Get the EPG event (timeshift) stream info from cache or resolve it (and cache it)
+  bool TimeShiftStreamInfo(const std::string & eventId, StreamInfo & info);
+
+  // the jobs (run by the job thread, public for measuring them in isolation)
+  //! Login (when needed and the retry delay elapsed), the retries are backed off
+  //! \return true if the login was attempted
+  bool LoginJob();
+  bool LoadPlayList();
+  //! \param stored flag if the playlist is the stored one (not fresh from backend)
+  void ApplyPlayList(const Json::Value & root, bool stored);
+  bool LoadEPG(time_t iStart, bool bSmallStep);
+  //! \return true if actual update was performed
+  bool LoadEPGJob();
+  void ReleaseUnneededEPG();
+  bool LoadRecordings();
+  //! \param stored flag if the recordings are the stored ones (not fresh from backend)
+  void ApplyRecordings(const Json::Value & root, bool stored);
+  void RegisterDrm();
+  //! \return true if some timer changed its state or recordings reload was requested
+  bool TimersTransitionJob();
+  //! \return true if deferred recordings load was triggered
+  bool DeferredLoadRecordingsJob();
+  //! Pre-resolve the timeshift of currently airing programmes on recently watched channels
+  bool TimeShiftPrefetchJob();
+  void StoreEPG();
+  //! Write the API call statistics and the catalog memory usage to the stats files (and log)
+  void DumpStats() const;
+  //! \return approximate heap footprint and entry counts of the published snapshots
+  std::string CatalogMemoryReport(bool perChannel) const;
+
+private:
+  bool KeepAlive() const;
+  void Process();
+  void KeepAliveJob();
+  void TriggerFullRefresh();
+  template<typename Job>
+    bool SimpleLoadJob(bool & jobGuard, const Job & job);
+  void LoadStoredEPG();
+  //! Publish new recordings (with its index), the m_mutex must be locked
+  void SetRecordings(std::shared_ptr<const recording_container_t> recordings);
+  //! \return stable unique id for the channel (from/into m_channelUids)
+  int ChannelUniqueId(const std::string & channelId, bool & newlyAssigned);
+  void LoadChannelUids();
+  void SaveChannelUids() const;
+  std::string InstanceFilePath(const std::string & name) const;
+  std::string ChannelStreamType(const std::string & channelId) const;
+  //! Precompute the stream properties of all channels (on channels/DRM change)
+  void UpdateChannelsProperties();
+  //! Record the startup \param milestone (if not yet), report the startup when all are reached
+  void StartupMilestone(std::chrono::steady_clock::duration StartupMetrics::* milestone);
+  //! Log the startup summary and keep it in the startup stats file (the last STARTUP_STATS_MAX ones)
+  void ReportStartup();
+
+private:
+  bool                              m_bKeepAlive;
+  bool                              m_bLoadRecordings;
+  bool                              m_bLoadPlayList;
+  bool                              m_bRegisterDrm;
+  mutable std::mutex                m_mutex;
+  bool                              m_bChannelsLoaded;
+  mutable std::condition_variable   m_waitCond;
+  std::thread                       m_thread;
+
+  // published data (used by multiple threads...)
+  CatalogSnapshot m_catalog;
+  long long m_recordingAvailableDuration;
+  long long m_recordingRecordedDuration;
+  time_t m_epgMinTime;
+  time_t m_epgMaxTime;
+  int m_epgMaxFutureDays;
+  int m_epgMaxPastDays;
+  std::shared_ptr<const std::string> m_drmCertificate;
+  std::shared_ptr<const std::string> m_drmLicenseUrl;
+  time_t m_nextTimerTransition; //!< the nearest start/end of some timer (0 - needs to be recomputed)
+  std::deque<std::string> m_recentChannels; //!< ids of recently watched channels (the latest first)
+  time_t m_nextTimeShiftPrefetch; //!< the time of next timeshift pre-resolution (0 - needs to be recomputed)
+  time_t m_loadRecordingsAt; //!< time of the deferred recordings load (0 - none requested)
+  stream_info_cache_t m_recordingStreams; //!< cache of resolved recordings stream info
+  stream_info_cache_t m_timeShiftStreams; //!< cache of resolved EPG events (timeshift) stream info
+  time_t m_catalogTime; //!< time when the published channels were obtained from backend
+  bool m_bOffline; //!< flag if backend is unreachable and stored data are served
+  time_t m_epgLoadedStart; //!< start of the EPG window loaded from backend (0 - nothing loaded)
+  time_t m_epgLoadedEnd; //!< end of the EPG window loaded from backend
+  mutable StartupMetrics m_startup;
+
+  // data used only by "job" thread
+  std::map<std::string, int> m_channelUids; //!< channel id -> assigned unique id (persisted)
+  std::set<int> m_usedChannelUids; //!< all values from m_channelUids
+  ApiManager::Fingerprint_t m_playlistFingerprint; //!< fingerprint of the last applied playlist
+  ApiManager::Fingerprint_t m_pvrFingerprint; //!< fingerprint of the last applied recordings/timers
+  std::map<std::pair<time_t, bool>, ApiManager::Fingerprint_t> m_epgFingerprints; //!< fingerprints of the last applied EPG windows (start, small step)
+  std::shared_ptr<const epg_container_t> m_storedEpg; //!< the last EPG written to disk
+  bool m_bLogin; //!< flag if the (re)login is needed, the backend jobs are suspended meanwhile
+  time_t m_nextLoginAttempt; //!< time of the next login attempt
+  unsigned m_loginRetryDelay; //!< delay (seconds) of the next login retry
+  bool m_bEGPLoaded;
+  time_t m_iLastStart;
+  time_t m_iLastEnd;
+
+  const Settings m_settings;
+  const std::shared_ptr<ApiManager> m_manager;
+  const std::shared_ptr<FileSystem> m_fileSystem;
+  const uint64_t m_instanceNo;
+  CatalogSink & m_sink;
+};
+
+} // namespace sledovanitvcz
+#endif // sledovanitvcz_CatalogManager_h
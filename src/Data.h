@@ -27,120 +27,21 @@
 #ifndef sledovanitvcz_Data_h
 #define sledovanitvcz_Data_h
 
-#include <vector>
 #include "kodi/addon-instance/PVR.h"
-#include <thread>
 #include "ApiManager.h"
-#include <mutex>
+#include "CatalogManager.h"
 #include <memory>
-#include <condition_variable>
-#include <map>
+#include <string>
+#include <vector>
 
 namespace sledovanitvcz
 {
 
-struct EpgEntry
-{
-  unsigned    iBroadcastId;
-  int         iChannelId;
-  int         iGenreType;
-  int         iGenreSubType;
-  time_t      startTime;
-  time_t      endTime;
-  std::string strTitle;
-  std::string strPlotOutline;
-  std::string strPlot;
-  std::string strIconPath;
-  std::string strGenreString;
-  std::string strEventId;
-  bool availableTimeshift;
-  std::string strRecordId; // optionally recorded
-  int starRating;
-  int parentalRating;
-};
-
-typedef std::map<time_t, EpgEntry> epg_entry_container_t;
-struct EpgChannel
-{
-  std::string                  strId;
-  std::string                  strName;
-  epg_entry_container_t epg;
-};
-
-struct Channel
-{
-  bool        bIsRadio;
-  int         iUniqueId;
-  int         iChannelNumber;
-  int         iEncryptionSystem;
-  int         iTvgShift;
-  std::string strChannelName;
-  std::string strIconPath;
-  std::string strStreamURL;
-  std::string strId;
-  std::string strGroupId;
-  std::string strStreamType;
-  bool        bIsPinLocked;
-  bool        bIsDrm;
-};
-
-struct ChannelGroup
-{
-  bool              bRadio;
-  std::string       strGroupId;
-  std::string       strGroupName;
-  std::vector<int>  members;
-};
-
-struct Recording
-{
-  std::string		strRecordId;
-  std::string		strTitle;
-  std::string		strStreamUrl;
-  std::string		strPlotOutline;
-  std::string		strPlot;
-  std::string		strChannelName;
-  time_t		startTime;
-  int			duration;
-  std::string strDirectory;
-  bool bRadio;
-  int iLifeTime;
-  std::string strStreamType;
-  int iChannelUid;
-  bool bIsPinLocked;
-  bool bIsDrm;
-};
-
-struct Timer
-{
-  unsigned int    iClientIndex;
-  int             iClientChannelUid;
-  time_t          startTime;
-  time_t          endTime;
-  PVR_TIMER_STATE state;                                     /*!< @brief (required) the state of this timer */
-  std::string     strTitle;
-  std::string     strSummary;
-  int             iLifetime;
-  bool            bIsRepeating;
-  time_t          firstDay;
-  int             iWeekdays;
-  int             iEpgUid;
-  unsigned int    iMarginStart;
-  unsigned int    iMarginEnd;
-  int             iGenreType;
-  int             iGenreSubType;
-  int iLifeTime;
-  std::string strDirectory;
-};
-
-typedef std::vector<ChannelGroup> group_container_t;
-typedef std::vector<Channel> channel_container_t;
-typedef std::map<std::string, EpgChannel> epg_container_t;
-typedef std::vector<Recording> recording_container_t;
-typedef std::vector<Timer> timer_container_t;
-typedef std::map<std::string, std::string> properties_t;
-
-class ATTR_DLL_LOCAL Data : public kodi::addon::CInstancePVRClient
+/*!
+ * \brief The Kodi adapter: converts the \sa CatalogManager snapshots into the
+ * Kodi types and forwards the catalog notifications to Kodi.
+ */
+class ATTR_DLL_LOCAL Data : public kodi::addon::CInstancePVRClient, private CatalogSink
 {
 public:
   Data(const kodi::addon::IInstanceInfo& instance);
@@ -177,80 +78,32 @@ public:
   PVR_ERROR DeleteTimer(const kodi::addon::PVRTimer& timer, bool forceDelete) override;
   PVR_ERROR GetDriveSpace(uint64_t& total, uint64_t& used) override;
 
-  bool LoggedIn() const;
-
 protected:
-  static int ParseDateTime(std::string strDate);
+  // CatalogSink
+  void ConnectionChanged(ConnectionState_t state) override;
+  void ChannelsChanged(size_t channelCount) override;
+  void RecordingsChanged() override;
+  void TimersChanged() override;
+  void EpgChanged(const EpgEntry & entry, EpgChange_t change) override;
 
 protected:
-  bool KeepAlive();
-  void KeepAliveJob();
-  bool LoadPlayList(void);
-  bool LoadEPG(time_t iStart, bool bSmallStep);
-  void ReleaseUnneededEPG();
-  //! \return true if actual update was performed
-  bool LoadEPGJob();
-  bool LoadRecordings();
-  template<typename Job>
-    bool SimpleLoadJob(bool & jobGuard, const Job & job);
-  void SetLoadRecordings();
-  void SetLoadPlaylist();
-  void LoginLoop();
-  bool WaitForChannels() const;
-  void TriggerFullRefresh();
-  bool RecordingExists(const std::string & recordId) const;
-  std::string ChannelsList() const;
-  std::string ChannelStreamType(const std::string & channelId) const;
+  CatalogManager::Settings CatalogSettings();
+  std::string InstanceFilePath(const std::string & name) const;
+  //! \return the transport of the API calls, with the capture/replay if configured
+  std::shared_ptr<Transport> CreateTransport();
   bool PinCheckUnlock(bool isPinLocked, bool & unlockedNow);
-  std::vector<kodi::addon::PVRStreamProperty> StreamProperties(const std::string & url, const std::string & streamType, bool isDrm, bool isLive) const;
-  PVR_ERROR GetChannelStreamUrl(const kodi::addon::PVRChannel& channel, std::string & streamUrl, std::string & streamType, bool & isDrm);
   PVR_ERROR GetEPGStreamUrl(const kodi::addon::PVREPGTag& tag, std::string & streamUrl, std::string & streamType, bool & isDrm);
   PVR_ERROR GetRecordingStreamUrl(const std::string & recording, std::string & streamUrl, std::string & streamType, bool & isDrm);
-  PVR_ERROR SetEPGMaxDays(int iFutureDays, int iPastDays);
-  void registerDrm();
-
-protected:
-  void Process(void);
+  static void ToKodi(const stream_properties_t & properties, std::vector<kodi::addon::PVRStreamProperty> & kodiProperties);
 
 private:
-  bool                              m_bKeepAlive;
-  bool                              m_bLoadRecordings;
-  bool                              m_bLoadPlayList;
-  mutable std::mutex                m_mutex;
-  bool                              m_bChannelsLoaded;
-  mutable std::condition_variable   m_waitCond;
-  std::thread                       m_thread;
-
-  // stored data from backend (used by multiple threads...)
-  std::shared_ptr<const group_container_t> m_groups;
-  std::shared_ptr<const channel_container_t> m_channels;
-  std::shared_ptr<const epg_container_t> m_epg;
-  std::shared_ptr<const recording_container_t> m_recordings;
-  std::shared_ptr<const timer_container_t> m_timers;
-  long long m_recordingAvailableDuration;
-  long long m_recordingRecordedDuration;
-  time_t m_epgMinTime;
-  time_t m_epgMaxTime;
-  int m_epgMaxFutureDays;
-  int m_epgMaxPastDays;
-  std::shared_ptr<const std::string> m_drmCertificate;
-  std::shared_ptr<const std::string> m_drmLicenseUrl;
-
-  // data used only by "job" thread
-  bool m_bEGPLoaded;
-  time_t m_iLastStart;
-  time_t m_iLastEnd;
-  ApiManager::StreamQuality_t m_streamQuality;
-  unsigned m_fullChannelEpgRefresh; //!< delay (seconds) between full channel/EPG refresh
-  unsigned m_loadingsRefresh; //!< delay (seconds) between loadings refresh
-  unsigned m_keepAliveDelay; //!< delay (seconds) between keepalive calls
-  unsigned m_epgCheckDelay; //!< delay (seconds) between checking if EPG load is needed
-  bool m_useH265; //!< flag, if h265 codec should be requested
-  bool m_useAdaptive; //!< flag, if inpustream.adaptive (aka adaptive bitrate streaming) should be used/requested
-  bool m_showLockedChannels; //!< flag, if unavailable/locked channels should be presented
-  bool m_showLockedOnlyPin; //!< flag, if PIN-locked only channels should be presented
+  bool m_traceStarted; //!< flag, if this instance writes the trace timeline
 
-  ApiManager                        m_manager;
+  const std::shared_ptr<FileSystem> m_fileSystem;
+  const uint64_t                    m_instanceNo;
+  const LogLevel_t                  m_logLevel; //!< the log level requested by this instance
+  const std::shared_ptr<ApiManager> m_manager;
+  CatalogManager                    m_catalog;
 };
 
 } //namespace sledovanitvcz
@@ -0,0 +1,108 @@
+/*
+ *      Copyright (c) 2018~now Palo Kisa <palo.kisa@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this addon; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include "KodiPlatform.h"
+#include "kodi/General.h"
+#include "kodi/Filesystem.h"
+
+namespace sledovanitvcz
+{
+
+void KodiLogger::Log(LogLevel_t level, const char * message)
+{
+  static const ADDON_LOG LEVELS[] = { ADDON_LOG_DEBUG, ADDON_LOG_DEBUG, ADDON_LOG_INFO, ADDON_LOG_WARNING, ADDON_LOG_ERROR };
+  kodi::Log(LEVELS[level], "%s", message);
+}
+
+bool KodiFileSystem::ReadFile(const std::string & path, std::string & content)
+{
+  kodi::vfs::CFile fileHandle;
+  if (!fileHandle.OpenFile(path, 0))
+    return false;
+  char buffer[1024];
+  while (ssize_t bytesRead = fileHandle.Read(buffer, sizeof (buffer)))
+  {
+    if (0 > bytesRead)
+      break;
+    content.append(buffer, bytesRead);
+  }
+  return true;
+}
+
+bool KodiFileSystem::WriteFile(const std::string & path, const std::string & content)
+{
+  kodi::vfs::CFile fileHandle;
+  if (!fileHandle.OpenFileForWrite(path, true))
+  {
+    kodi::Log(ADDON_LOG_ERROR, "Cannot write file %s", path.c_str());
+    return false;
+  }
+  return static_cast<ssize_t>(content.length()) == fileHandle.Write(content.c_str(), content.length());
+}
+
+bool KodiFileSystem::AppendFile(const std::string & path, const std::string & content)
+{
+  kodi::vfs::CFile fileHandle;
+  if (!fileHandle.OpenFileForWrite(path, false))
+  {
+    kodi::Log(ADDON_LOG_ERROR, "Cannot write file %s", path.c_str());
+    return false;
+  }
+  fileHandle.Seek(0, SEEK_END);
+  return static_cast<ssize_t>(content.length()) == fileHandle.Write(content.c_str(), content.length());
+}
+
+time_t KodiFileSystem::ModificationTime(const std::string & path)
+{
+  kodi::vfs::FileStatus status;
+  return kodi::vfs::StatFile(path, status) ? status.GetModificationTime() : 0;
+}
+
+std::string KodiFileSystem::UserPath(const std::string & name)
+{
+  return kodi::addon::GetUserPath(name);
+}
+
+bool KodiTransport::Get(const std::string & url, const std::string & userAgent, std::string & response, TransferInfo & info)
+{
+  std::string kodi_url = url;
+  // add User-Agent header (Kodi's protocol options)
+  if (!userAgent.empty())
+  {
+    kodi_url += "|User-Agent=";
+    kodi_url += userAgent;
+  }
+
+  kodi::vfs::CFile fh;
+  const auto start = std::chrono::steady_clock::now();
+  if (!fh.OpenFile(kodi_url, ADDON_READ_NO_CACHE))
+    return false;
+  info.firstByte = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+  char buffer[1024];
+  while (ssize_t bytesRead = fh.Read(buffer, sizeof (buffer)))
+  {
+    if (0 > bytesRead)
+      break;
+    response.append(buffer, bytesRead);
+  }
+  return true;
+}
+
+} // namespace sledovanitvcz
@@ -0,0 +1,55 @@
+/*
+ *      Copyright (c) 2018~now Palo Kisa <palo.kisa@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this addon; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#ifndef sledovanitvcz_KodiPlatform_h
+#define sledovanitvcz_KodiPlatform_h
+
+#include "Platform.h"
+
+namespace sledovanitvcz
+{
+
+//! Logging through kodi::Log()
+class KodiLogger : public Logger
+{
+public:
+  void Log(LogLevel_t level, const char * message) override;
+};
+
+//! Files through kodi::vfs, the user path from kodi::addon::GetUserPath()
+class KodiFileSystem : public FileSystem
+{
+public:
+  bool ReadFile(const std::string & path, std::string & content) override;
+  bool WriteFile(const std::string & path, const std::string & content) override;
+  bool AppendFile(const std::string & path, const std::string & content) override;
+  time_t ModificationTime(const std::string & path) override;
+  std::string UserPath(const std::string & name) override;
+};
+
+//! Network through kodi::vfs (Kodi's curl)
+class KodiTransport : public Transport
+{
+public:
+  bool Get(const std::string & url, const std::string & userAgent, std::string & response, TransferInfo & info) override;
+};
+
+} // namespace sledovanitvcz
+#endif // sledovanitvcz_KodiPlatform_h
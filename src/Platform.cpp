@@ -0,0 +1,87 @@
+/*
+ *      Copyright (c) 2018~now Palo Kisa <palo.kisa@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this addon; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include "Platform.h"
+#include <cstdarg>
+#include <cstdio>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <set>
+
+namespace sledovanitvcz
+{
+
+static std::shared_ptr<Logger> g_logger;
+std::atomic<int> g_logLevel{LL_DEBUG};
+static std::mutex g_logLevelsMutex;
+static std::multiset<int> g_logLevels; //!< levels requested by the instances
+
+void SetLogger(std::shared_ptr<Logger> logger)
+{
+  std::atomic_store(&g_logger, std::move(logger));
+}
+
+void AddLogLevel(LogLevel_t level)
+{
+  std::lock_guard<std::mutex> critical(g_logLevelsMutex);
+  g_logLevels.insert(level);
+  g_logLevel.store(*g_logLevels.cbegin(), std::memory_order_relaxed);
+}
+
+void RemoveLogLevel(LogLevel_t level)
+{
+  std::lock_guard<std::mutex> critical(g_logLevelsMutex);
+  auto level_i = g_logLevels.find(level);
+  if (g_logLevels.cend() != level_i)
+    g_logLevels.erase(level_i);
+  g_logLevel.store(g_logLevels.empty() ? LL_DEBUG : *g_logLevels.cbegin(), std::memory_order_relaxed);
+}
+
+void Log(LogLevel_t level, const char * format, ...)
+{
+  if (!LogEnabled(level))
+    return;
+  auto logger = std::atomic_load(&g_logger);
+  if (!logger)
+    return;
+
+  char buffer[1024];
+  va_list args;
+  va_start(args, format);
+  const int len = vsnprintf(buffer, sizeof (buffer), format, args);
+  va_end(args);
+  if (0 > len)
+    return;
+  if (static_cast<size_t>(len) < sizeof (buffer))
+  {
+    logger->Log(level, buffer);
+  } else
+  {
+    // the message doesn't fit into the stack buffer
+    std::vector<char> message(len + 1);
+    va_start(args, format);
+    vsnprintf(message.data(), message.size(), format, args);
+    va_end(args);
+    logger->Log(level, message.data());
+  }
+}
+
+} // namespace sledovanitvcz
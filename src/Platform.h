@@ -0,0 +1,131 @@
+/*
+ *      Copyright (c) 2018~now Palo Kisa <palo.kisa@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this addon; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#ifndef sledovanitvcz_Platform_h
+#define sledovanitvcz_Platform_h
+
+#include <string>
+#include <memory>
+#include <ctime>
+#include <chrono>
+#include <atomic>
+
+/*!
+ * \file Interfaces of the platform services used by the core (Kodi independent)
+ * part of the addon. The Kodi implementation is in KodiPlatform.h, other ones
+ * can be injected (e.g. for measuring the core in isolation).
+ */
+
+namespace sledovanitvcz
+{
+
+enum LogLevel_t
+{
+  LL_TRACE = 0
+    , LL_DEBUG
+    , LL_INFO
+    , LL_WARNING
+    , LL_ERROR
+};
+
+//! Sink of the log messages
+class Logger
+{
+public:
+  virtual ~Logger() = default;
+  virtual void Log(LogLevel_t level, const char * message) = 0;
+};
+
+//! Access to the files (persistent data)
+class FileSystem
+{
+public:
+  virtual ~FileSystem() = default;
+  virtual bool ReadFile(const std::string & path, std::string & content) = 0;
+  virtual bool WriteFile(const std::string & path, const std::string & content) = 0;
+  //! Append the \param content at the end of the file (created if not existing)
+  virtual bool AppendFile(const std::string & path, const std::string & content) = 0;
+  //! \return the modification time of the file, 0 if not available
+  virtual time_t ModificationTime(const std::string & path) = 0;
+  //! \return the path of the \param name file in the user (data) directory
+  virtual std::string UserPath(const std::string & name) = 0;
+};
+
+//! Details of a transfer, filled by the Transport (if it can measure them)
+struct TransferInfo
+{
+  //! time to open the url (connect + the response headers), negative if not known
+  std::chrono::microseconds firstByte{-1};
+};
+
+//! Access to the network
+class Transport
+{
+public:
+  virtual ~Transport() = default;
+  //! \return false if the \param url couldn't be opened
+  virtual bool Get(const std::string & url, const std::string & userAgent, std::string & response, TransferInfo & info) = 0;
+};
+
+//! Set the (global) sink of the messages logged by \sa Log()
+void SetLogger(std::shared_ptr<Logger> logger);
+
+/*!
+ * The lowest level of the messages passed to the logger is the most verbose
+ * one of the registered levels (requested by the living instances), LL_DEBUG
+ * if none is registered.
+ */
+void AddLogLevel(LogLevel_t level);
+//! Unregister the \param level registered by \sa AddLogLevel()
+void RemoveLogLevel(LogLevel_t level);
+
+extern std::atomic<int> g_logLevel;
+
+//! \return true if the messages of the \param level are passed to the logger
+inline bool LogEnabled(LogLevel_t level)
+{
+  return level >= g_logLevel.load(std::memory_order_relaxed);
+}
+
+#if defined(__GNUC__)
+__attribute__((format(printf, 2, 3)))
+#endif
+void Log(LogLevel_t level, const char * format, ...);
+
+} // namespace sledovanitvcz
+
+/*!
+ * Logging with the level check done before the arguments are evaluated, so
+ * the (possibly expensive) arguments of the disabled messages cost nothing.
+ * The LOG_TRACE messages are compiled out of the release (NDEBUG) builds
+ * unless SLEDOVANITV_TRACE_LOG is defined.
+ */
+#define SLEDOVANITV_LOG(level, ...) \
+  do { if (sledovanitvcz::LogEnabled(level)) sledovanitvcz::Log(level, __VA_ARGS__); } while (false)
+#define LOG_DEBUG(...) SLEDOVANITV_LOG(sledovanitvcz::LL_DEBUG, __VA_ARGS__)
+#if defined(NDEBUG) && !defined(SLEDOVANITV_TRACE_LOG)
+// keep the format checked, but never evaluated
+# define LOG_TRACE(...) \
+  do { if (false) sledovanitvcz::Log(sledovanitvcz::LL_TRACE, __VA_ARGS__); } while (false)
+#else
+# define LOG_TRACE(...) SLEDOVANITV_LOG(sledovanitvcz::LL_TRACE, __VA_ARGS__)
+#endif
+
+#endif // sledovanitvcz_Platform_h
@@ -0,0 +1,186 @@
+/*
+ *      Copyright (c) 2018~now Palo Kisa <palo.kisa@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this addon; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include "Trace.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <iterator>
+#include <mutex>
+#include <vector>
+
+namespace sledovanitvcz
+{
+
+static constexpr size_t TRACE_EVENTS_MAX = 100000; //!< max count of the not flushed events (the next are dropped)
+
+namespace
+{
+
+struct TraceEvent
+{
+  const char * name;
+  const char * category;
+  int64_t start;
+  int64_t duration;
+  unsigned thread;
+  const char * argNames[TraceSpan::ARGS_MAX];
+  int64_t argValues[TraceSpan::ARGS_MAX];
+};
+
+struct TraceState
+{
+  std::mutex mutex;
+  std::shared_ptr<FileSystem> fileSystem;
+  std::string path;
+  std::vector<TraceEvent> events;
+  size_t dropped = 0;
+};
+
+std::atomic<bool> g_enabled{false};
+std::atomic<unsigned> g_nextThread{0};
+TraceState g_state;
+
+int64_t NowUs()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+unsigned ThreadId()
+{
+  static thread_local const unsigned thread = ++g_nextThread;
+  return thread;
+}
+
+//! Write the events, the g_state.mutex must be locked
+void Flush(std::vector<TraceEvent> events)
+{
+  std::string content;
+  char buf[512];
+  for (const auto & event : events)
+  {
+    int len = std::snprintf(buf, sizeof (buf), "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%" PRId64 ",\"dur\":%" PRId64 ",\"pid\":1,\"tid\":%u"
+        , event.name, event.category, event.start, event.duration, event.thread);
+    for (size_t i = 0; i < TraceSpan::ARGS_MAX && nullptr != event.argNames[i] && 0 < len && len < static_cast<int>(sizeof (buf)); ++i)
+      len += std::snprintf(buf + len, sizeof (buf) - len, "%s\"%s\":%" PRId64, 0 == i ? ",\"args\":{" : ",", event.argNames[i], event.argValues[i]);
+    if (nullptr != event.argNames[0] && 0 < len && len < static_cast<int>(sizeof (buf)))
+      len += std::snprintf(buf + len, sizeof (buf) - len, "}");
+    content.append(buf, std::min(len, static_cast<int>(sizeof (buf)) - 1));
+    content += "},\n";
+  }
+  if (0 < g_state.dropped)
+  {
+    Log(LL_WARNING, "Trace: %u events dropped (too many not flushed)", static_cast<unsigned>(g_state.dropped));
+    g_state.dropped = 0;
+  }
+  if (!content.empty())
+    g_state.fileSystem->AppendFile(g_state.path, content);
+}
+
+} // namespace
+
+bool StartTrace(std::shared_ptr<FileSystem> fileSystem, const std::string & path)
+{
+  std::lock_guard<std::mutex> critical(g_state.mutex);
+  if (g_enabled)
+    return false;
+  // the JSON array format, the closing bracket is optional
+  if (!fileSystem->WriteFile(path, "[\n"))
+    return false;
+  g_state.fileSystem = std::move(fileSystem);
+  g_state.path = path;
+  g_state.events.clear();
+  g_state.dropped = 0;
+  g_enabled = true;
+  Log(LL_INFO, "Tracing into %s", path.c_str());
+  return true;
+}
+
+void StopTrace()
+{
+  std::lock_guard<std::mutex> critical(g_state.mutex);
+  if (!g_enabled)
+    return;
+  g_enabled = false;
+  Flush(std::move(g_state.events));
+  g_state.events.clear();
+  g_state.fileSystem.reset();
+}
+
+void FlushTrace()
+{
+  if (!TraceEnabled())
+    return;
+  std::vector<TraceEvent> events;
+  std::lock_guard<std::mutex> critical(g_state.mutex);
+  events.swap(g_state.events);
+  if (g_enabled)
+    Flush(std::move(events));
+}
+
+bool TraceEnabled()
+{
+  return g_enabled.load(std::memory_order_relaxed);
+}
+
+TraceSpan::TraceSpan(const char * name, const char * category/* = "addon"*/)
+  : m_name{name}
+  , m_category{category}
+  , m_start{TraceEnabled() ? NowUs() : -1}
+  , m_argNames{}
+  , m_argValues{}
+{
+}
+
+TraceSpan::~TraceSpan()
+{
+  if (0 > m_start || !TraceEnabled())
+    return;
+  TraceEvent event{m_name, m_category, m_start, NowUs() - m_start, ThreadId(), {}, {}};
+  std::copy(std::begin(m_argNames), std::end(m_argNames), std::begin(event.argNames));
+  std::copy(std::begin(m_argValues), std::end(m_argValues), std::begin(event.argValues));
+  std::lock_guard<std::mutex> critical(g_state.mutex);
+  if (g_state.events.size() < TRACE_EVENTS_MAX)
+    g_state.events.push_back(event);
+  else
+    ++g_state.dropped;
+}
+
+void TraceSpan::SetArg(const char * name, int64_t value)
+{
+  for (size_t i = 0; i < ARGS_MAX; ++i)
+  {
+    if (nullptr == m_argNames[i])
+    {
+      m_argNames[i] = name;
+      m_argValues[i] = value;
+      return;
+    }
+  }
+}
+
+void TraceSpan::Discard()
+{
+  m_start = -1;
+}
+
+} // namespace sledovanitvcz
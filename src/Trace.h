@@ -0,0 +1,74 @@
+/*
+ *      Copyright (c) 2018~now Palo Kisa <palo.kisa@gmail.com>
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this addon; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#ifndef sledovanitvcz_Trace_h
+#define sledovanitvcz_Trace_h
+
+#include "Platform.h"
+#include <cstddef>
+#include <cstdint>
+
+/*!
+ * \file Timeline of the work in the Chrome trace-event format (to be opened by
+ * chrome://tracing or https://ui.perfetto.dev). The spans are collected just
+ * while the tracing is started, otherwise a span costs one relaxed atomic load.
+ */
+
+namespace sledovanitvcz
+{
+
+/*!
+ * \brief Start collecting the spans, the \param path file is (re)created
+ * \return false if the tracing is already started (one trace per process)
+ */
+bool StartTrace(std::shared_ptr<FileSystem> fileSystem, const std::string & path);
+//! Flush the collected spans and stop the tracing
+void StopTrace();
+//! Append the collected spans to the trace file
+void FlushTrace();
+bool TraceEnabled();
+
+//! Span (the "complete" event) from the construction to the destruction
+class TraceSpan
+{
+public:
+  //! \note the \param name and \param category must be static strings (literals)
+  explicit TraceSpan(const char * name, const char * category = "addon");
+  ~TraceSpan();
+  TraceSpan(const TraceSpan &) = delete;
+  TraceSpan & operator =(const TraceSpan &) = delete;
+
+  static constexpr size_t ARGS_MAX = 2;
+
+  //! Attach the value (shown in the span details), up to \sa ARGS_MAX per span (the next are ignored)
+  void SetArg(const char * name, int64_t value);
+  //! Don't record the span (e.g. nothing was done)
+  void Discard();
+
+private:
+  const char * const m_name;
+  const char * const m_category;
+  int64_t m_start; //!< [us], negative if not recorded
+  const char * m_argNames[ARGS_MAX];
+  int64_t m_argValues[ARGS_MAX];
+};
+
+} // namespace sledovanitvcz
+#endif // sledovanitvcz_Trace_h